@@ -0,0 +1,193 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// Microbenchmark of the section classifier (see blocks.h).
+//
+// Usage: bench_classify [segment.png...]
+//
+// Compares the original column-major loop, the scalar row-major kernel and
+// the kernel classifyColumns() uses, on the given segments (or a synthetic
+// 200x22 one) and on a synthetic 100k-column image, in RGB8 and RGBA8.
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include <lair/core/lair.h>
+
+#include "blocks.h"
+
+
+using namespace lair;
+
+
+typedef void (*ClassifyFunc)(const uint8*, unsigned, unsigned, unsigned, unsigned,
+                             unsigned, unsigned, uint32*, uint32*);
+
+
+struct TestImage {
+	std::string        name;
+	unsigned           width;
+	unsigned           height;
+	unsigned           pxSize;
+	std::vector<uint8> pixels;
+};
+
+
+// The loop Map::appendSection() used before the row-major kernels.
+void classifyColumnMajor(const uint8* pixels, unsigned pxSize, unsigned stride,
+                         unsigned /*width*/, unsigned height,
+                         unsigned first, unsigned count,
+                         uint32* walls, uint32* points) {
+	for(unsigned col = 0; col < count; ++col) {
+		walls [col] = 0;
+		points[col] = 0;
+		for(unsigned row = 0; row < height; ++row) {
+			unsigned frow = height - row - 1; // vertical flip
+			const uint8* pixel = pixels + frow * stride + (first + col) * pxSize;
+			uint8 r = pixel[0];
+			uint8 g = pixel[1];
+			uint8 b = pixel[2];
+			if(r == 0 && g == 0 && b == 0) {
+				walls[col] |= 1u << row;
+			}
+			if(r == 0 && g == 255 && b == 0) {
+				points[col] |= 1u << row;
+			}
+		}
+	}
+}
+
+
+// Roughly the density of the shipped segments: 10% walls, 3% points.
+TestImage syntheticImage(unsigned width, unsigned height, unsigned pxSize) {
+	TestImage img{ "synthetic " + std::to_string(width) + "x" + std::to_string(height),
+	               width, height, pxSize, std::vector<uint8>(width * height * pxSize) };
+	std::mt19937 rand(42);
+	for(unsigned i = 0; i < width * height; ++i) {
+		uint8* p = &img.pixels[i * pxSize];
+		unsigned r = rand() % 100;
+		p[0] = (r < 13)? 0: 255;
+		p[1] = (r < 10)? 0: 255;
+		p[2] = (r < 13)? 0: 255;
+		if(pxSize == 4)
+			p[3] = 255;
+	}
+	return img;
+}
+
+
+bool loadImage(TestImage& img, const char* path, unsigned pxSize) {
+	SDL_Surface* surface = IMG_Load(path);
+	if(!surface) {
+		fprintf(stderr, "Failed to load \"%s\": %s\n", path, IMG_GetError());
+		return false;
+	}
+	// Byte order R, G, B(, A).
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	Uint32 format = (pxSize == 4)? SDL_PIXELFORMAT_RGBA8888: SDL_PIXELFORMAT_RGB24;
+#else
+	Uint32 format = (pxSize == 4)? SDL_PIXELFORMAT_ABGR8888: SDL_PIXELFORMAT_RGB24;
+#endif
+	SDL_Surface* conv = SDL_ConvertSurfaceFormat(surface, format, 0);
+	SDL_FreeSurface(surface);
+	if(!conv)
+		return false;
+
+	img.name   = path;
+	img.width  = conv->w;
+	img.height = conv->h;
+	img.pxSize = pxSize;
+	img.pixels.resize(img.width * img.height * pxSize);
+	SDL_LockSurface(conv);
+	for(unsigned y = 0; y < img.height; ++y) {
+		const uint8* src = static_cast<const uint8*>(conv->pixels) + y * conv->pitch;
+		std::copy(src, src + img.width * pxSize, &img.pixels[y * img.width * pxSize]);
+	}
+	SDL_UnlockSurface(conv);
+	SDL_FreeSurface(conv);
+	return true;
+}
+
+
+// Average time in ns to classify a whole image.
+double timeClassify(ClassifyFunc func, const TestImage& img,
+                    std::vector<uint32>& walls, std::vector<uint32>& points) {
+	typedef std::chrono::steady_clock Clock;
+
+	walls .resize(img.width);
+	points.resize(img.width);
+
+	unsigned iterations = std::max(10u, 20000000u / (img.width * img.height));
+	Clock::time_point start = Clock::now();
+	for(unsigned i = 0; i < iterations; ++i) {
+		func(img.pixels.data(), img.pxSize, img.width * img.pxSize, img.width, img.height,
+		     0, img.width, walls.data(), points.data());
+	}
+	Clock::duration time = Clock::now() - start;
+
+	return std::chrono::duration<double, std::nano>(time).count() / iterations;
+}
+
+
+bool bench(const TestImage& img) {
+	std::vector<uint32> refWalls, refPoints, walls, points;
+
+	double ref    = timeClassify(classifyColumnMajor,   img, refWalls, refPoints);
+	double scalar = timeClassify(classifyColumnsScalar, img, walls, points);
+	bool ok = (walls == refWalls && points == refPoints);
+	double best   = timeClassify(classifyColumns,       img, walls, points);
+	ok = ok && (walls == refWalls && points == refPoints);
+
+	printf("%-32s %s  column-major %10.0f ns  scalar %10.0f ns (x%.1f)  %s %10.0f ns (x%.1f)%s\n",
+	       img.name.c_str(), (img.pxSize == 4)? "RGBA8": "RGB8 ",
+	       ref, scalar, ref / scalar, classifyKernelName(), best, ref / best,
+	       ok? "": "  MISMATCH");
+	return ok;
+}
+
+
+int main(int argc, char** argv) {
+	bool ok = true;
+	for(unsigned pxSize = 3; pxSize <= 4; ++pxSize) {
+		if(argc > 1) {
+			IMG_Init(IMG_INIT_PNG);
+			for(int i = 1; i < argc; ++i) {
+				TestImage img;
+				if(loadImage(img, argv[i], pxSize))
+					ok = bench(img) && ok;
+			}
+			IMG_Quit();
+		}
+		else {
+			ok = bench(syntheticImage(200, 22, pxSize)) && ok;
+		}
+		ok = bench(syntheticImage(100000, 22, pxSize)) && ok;
+	}
+	return ok? EXIT_SUCCESS: EXIT_FAILURE;
+}
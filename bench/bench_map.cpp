@@ -0,0 +1,401 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// Microbenchmarks of the map, collision and render-building hot paths.
+//
+// Usage: bench_map [assets-dir]
+//
+// Each benchmark is run REPEATS times and reports the best time per
+// operation, and the heap allocations per operation of the last run. The
+// map they run on is made of the segments of maps.json, repeated up to
+// LENGTH columns, so results can be compared from one build to another.
+// Without the assets, the segment benchmarks are skipped and the map is
+// random.
+
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+#include <lair/core/json.h>
+
+#include "blocks.h"
+#include "level_file.h"
+#include "ship_parts.h"
+#include "simulation.h"
+#include "map.h"
+
+
+using namespace lair;
+
+
+enum {
+	LENGTH     = 100000,
+	ROWS       = 22,
+	BLOCK_SIZE = 48,
+	REPEATS    = 5,
+};
+
+
+// Every heap allocation of the program goes through here.
+static size_t allocCount = 0;
+
+void* operator new(size_t size) {
+	++allocCount;
+	void* p = std::malloc(size? size: 1);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+
+volatile unsigned sink;
+
+
+// Run setup then run REPEATS times; run returns the number of operations it
+// did.
+template<typename Setup, typename Run>
+void bench(const std::string& name, Setup setup, Run run) {
+	typedef std::chrono::steady_clock Clock;
+
+	double bestNs = INFINITY;
+	double allocs = 0;
+	for(unsigned rep = 0; rep < REPEATS; ++rep) {
+		setup();
+		size_t allocs0 = allocCount;
+		Clock::time_point start = Clock::now();
+		unsigned ops = run();
+		Clock::time_point end = Clock::now();
+
+		double ns = std::chrono::duration<double, std::nano>(end - start).count();
+		bestNs = std::min(bestNs, ns / ops);
+		allocs = double(allocCount - allocs0) / ops;
+	}
+	printf("%-60s %10.1f ns/op %8.2f allocs/op\n", name.c_str(), bestNs, allocs);
+}
+
+void noSetup() {}
+
+
+struct Segment {
+	std::string         name;
+	unsigned            width;
+	unsigned            height;
+	std::vector<uint8>  pixels; // RGBA
+	std::vector<uint32> walls;
+	std::vector<uint32> points;
+};
+
+
+bool loadSegment(Segment& seg, const std::string& path) {
+	SDL_Surface* surface = IMG_Load(path.c_str());
+	if(!surface) {
+		fprintf(stderr, "Failed to load \"%s\": %s\n", path.c_str(), IMG_GetError());
+		return false;
+	}
+	// Byte order R, G, B, A.
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	Uint32 format = SDL_PIXELFORMAT_RGBA8888;
+#else
+	Uint32 format = SDL_PIXELFORMAT_ABGR8888;
+#endif
+	SDL_Surface* conv = SDL_ConvertSurfaceFormat(surface, format, 0);
+	SDL_FreeSurface(surface);
+	if(!conv || conv->h > ROWS) {
+		SDL_FreeSurface(conv);
+		return false;
+	}
+
+	seg.width  = conv->w;
+	seg.height = conv->h;
+	seg.pixels.resize(seg.width * seg.height * 4);
+	SDL_LockSurface(conv);
+	for(unsigned y = 0; y < seg.height; ++y) {
+		const uint8* src = static_cast<const uint8*>(conv->pixels) + y * conv->pitch;
+		std::copy(src, src + seg.width * 4, &seg.pixels[y * seg.width * 4]);
+	}
+	SDL_UnlockSurface(conv);
+	SDL_FreeSurface(conv);
+
+	seg.walls .resize(seg.width);
+	seg.points.resize(seg.width);
+	classifyColumns(seg.pixels.data(), 4, seg.width * 4, seg.width, seg.height,
+	                0, seg.width, seg.walls.data(), seg.points.data());
+	return true;
+}
+
+
+bool parseJsonFile(Json::Value& json, const std::string& path) {
+	Json::Reader reader;
+	std::ifstream in(path);
+	return in && reader.parse(in, json);
+}
+
+
+// The levels of maps.json, as indices in segments.
+typedef std::vector<std::vector<unsigned>> LevelVector;
+
+bool loadLevels(std::vector<Segment>& segments, LevelVector& levels,
+                const Json::Value& maps, const std::string& assetsDir) {
+	for(unsigned level = 0; level < maps.size(); ++level) {
+		const Json::Value& names = maps[level]["segments"];
+		levels.emplace_back();
+		for(unsigned i = 0; i < names.size(); ++i) {
+			std::string name = names[i].asString();
+			if(name.empty())
+				continue;
+
+			unsigned si = 0;
+			while(si < segments.size() && segments[si].name != name) ++si;
+			if(si == segments.size()) {
+				segments.emplace_back();
+				segments.back().name = name;
+				if(!loadSegment(segments.back(), assetsDir + "/" + name))
+					return false;
+			}
+			levels.back().push_back(si);
+		}
+	}
+	return true;
+}
+
+
+// The segments of every level one after the other, repeated up to LENGTH
+// columns, or random blocks if there are no segments.
+void buildColumns(std::vector<uint32>& walls, std::vector<uint32>& points,
+                  const std::vector<Segment>& segments, const LevelVector& levels) {
+	walls .clear();
+	points.clear();
+	size_t prevSize = -1;
+	while(walls.size() < LENGTH && walls.size() != prevSize) {
+		prevSize = walls.size();
+		for(const std::vector<unsigned>& level: levels) {
+			for(unsigned si: level) {
+				const Segment& seg = segments[si];
+				walls .insert(walls .end(), seg.walls .begin(), seg.walls .end());
+				points.insert(points.end(), seg.points.begin(), seg.points.end());
+			}
+		}
+	}
+
+	bool random = walls.empty();
+	std::mt19937 rand(42);
+	walls .resize(LENGTH);
+	points.resize(LENGTH);
+	for(unsigned col = 0; random && col < LENGTH; ++col) {
+		for(unsigned row = 0; row < ROWS; ++row) {
+			unsigned r = rand() % 100;
+			if(r < 10)
+				walls [col] |= 1u << row;
+			else if(r < 13)
+				points[col] |= 1u << row;
+		}
+	}
+}
+
+
+int main(int argc, char** argv) {
+	std::string assetsDir = (argc > 1)? argv[1]: "assets";
+
+	Json::Value maps;
+	std::vector<Segment> segments;
+	LevelVector levels;
+	IMG_Init(IMG_INIT_PNG);
+	if(!parseJsonFile(maps, assetsDir + "/maps.json")
+	|| !loadLevels(segments, levels, maps, assetsDir)) {
+		fprintf(stderr, "No assets in \"%s\", using a random map.\n", assetsDir.c_str());
+		segments.clear();
+		levels.clear();
+	}
+	IMG_Quit();
+
+	std::vector<uint32> walls;
+	std::vector<uint32> points;
+	buildColumns(walls, points, segments, levels);
+
+	Map map(nullptr, BLOCK_SIZE);
+	auto resetMap = [&]() {
+		map.clear();
+		map.appendColumns(walls.data(), points.data(), LENGTH);
+		map.stream(0, LENGTH);
+	};
+
+	// Map::beginIndex
+	{
+		std::vector<int> cols(1000000);
+		std::mt19937 rand(1);
+		for(int& col: cols)
+			col = int(rand() % (LENGTH + 100)) - 50;
+		resetMap();
+		bench("Map::beginIndex", noSetup, [&]() {
+			unsigned sum = 0;
+			for(int col: cols)
+				sum += map.beginIndex(col);
+			sink = sum;
+			return unsigned(cols.size());
+		});
+	}
+
+	// Sections, as Map::appendSection() would classify them the first time
+	// and append them from the cache after.
+	if(!segments.empty()) {
+		std::vector<uint32> w(LENGTH);
+		std::vector<uint32> p(LENGTH);
+		bench("classifyColumns (segment)", noSetup, [&]() {
+			for(const Segment& seg: segments) {
+				classifyColumns(seg.pixels.data(), 4, seg.width * 4, seg.width, seg.height,
+				                0, seg.width, w.data(), p.data());
+			}
+			return unsigned(segments.size());
+		});
+
+		bench("Map::appendColumns + stream (segment)", noSetup, [&]() {
+			for(const Segment& seg: segments) {
+				map.clear();
+				map.appendColumns(seg.walls.data(), seg.points.data(), seg.width);
+				map.stream(0, seg.width);
+			}
+			return unsigned(segments.size());
+		});
+
+		bench("Map::appendColumns + stream (level)", noSetup, [&]() {
+			for(const std::vector<unsigned>& level: levels) {
+				map.clear();
+				for(unsigned si: level) {
+					const Segment& seg = segments[si];
+					map.appendColumns(seg.walls.data(), seg.points.data(), seg.width);
+				}
+				map.stream(0, map.length());
+			}
+			return unsigned(levels.size());
+		});
+
+		unsigned compiled = 0;
+		for(unsigned level = 0; level < levels.size(); ++level) {
+			compiled += map.loadCompiled(buildDataPath(Path(assetsDir)) / Path(levelFilePath(level)),
+			                             hashSegments(maps[level]["segments"], Path(assetsDir)));
+		}
+		if(compiled == levels.size()) {
+			bench("Map::loadCompiled + stream (level)", noSetup, [&]() {
+				for(unsigned level = 0; level < levels.size(); ++level) {
+					map.loadCompiled(buildDataPath(Path(assetsDir)) / Path(levelFilePath(level)),
+					                 hashSegments(maps[level]["segments"], Path(assetsDir)));
+					map.stream(0, map.length());
+				}
+				return unsigned(levels.size());
+			});
+		}
+	}
+
+	// Warning detection, as in Simulation::tick(): a column further each
+	// tick, every row.
+	bench("Map::hasWallAtYInRange (warning tick)", resetMap, [&]() {
+		unsigned count = 0;
+		for(int col = 1; col < LENGTH; ++col) {
+			int begin = map.beginIndex(col - 1);
+			int end   = map.beginIndex(col);
+			for(int y = 1; y < ROWS - 1; ++y)
+				count += map.hasWallAtYInRange(y, begin, end);
+		}
+		sink = count;
+		return unsigned(LENGTH - 1);
+	});
+
+	// Collision and pickups of the ship, at various speeds and shapes. Each
+	// tick starts from a fresh state further on the map.
+	const char* ships[] = { "ship_default.json", "ship_swarm.json" };
+	for(const char* shipName: ships) {
+		Json::Value shipJson;
+		ShipDef shipDef;
+		if(!parseJsonFile(shipJson, assetsDir + "/" + shipName)
+		|| !shipDef.load(shipJson, BLOCK_SIZE, dbgLogger)) {
+			fprintf(stderr, "Failed to load \"%s\", skipping.\n", shipName);
+			continue;
+		}
+
+		Simulation sim(&map, BLOCK_SIZE);
+		sim.start(shipDef);
+		SimState base = sim.state();
+		unsigned shapes[] = { 0, shipDef.shapeCount() - 1 };
+		float    speeds[] = { 1000, 4000, 16000, 64000 };
+		for(unsigned shape: shapes) {
+			for(float speed: speeds) {
+				char name[128];
+				snprintf(name, sizeof(name), "Simulation::tick (%s, shape %u, %.0f px/s)",
+				         shipName, shape, speed);
+				base.shipShape  = shape;
+				base.shipHSpeed = speed;
+				base.parts.reset(shipDef, shape);
+				SimInput input = { 0, 0 };
+				bench(name, resetMap, [&]() {
+					unsigned ticks = 0;
+					for(int col = 0; col + 100 < LENGTH; col += 20, ++ticks) {
+						base.scrollPos     = col * BLOCK_SIZE;
+						base.prevScrollPos = base.scrollPos;
+						base.warningTileX  = (base.scrollPos + SCREEN_WIDTH) / BLOCK_SIZE;
+						sim.setState(base);
+						sink = sim.tick(input);
+					}
+					return ticks;
+				});
+			}
+		}
+	}
+
+	// The CPU side of Map::render() and renderPreview() with TILES_SPRITES,
+	// scrolling at 4000 px/s and 60 frames per second.
+	Map::QuadVector quads;
+	bench("Map::build{Warnings,Tiles,Preview} (frame)", resetMap, [&]() {
+		unsigned frames = 0;
+		float pDist = 4000;
+		for(float scroll = 0; scroll + 2 * SCREEN_WIDTH + pDist < LENGTH * BLOCK_SIZE;
+		    scroll += pDist / 60, ++frames) {
+			quads.clear();
+			map.buildWarnings(scroll, pDist, SCREEN_WIDTH, quads);
+			map.buildTiles(scroll, quads);
+			map.buildPreview(scroll, pDist, SCREEN_WIDTH, 70, quads);
+		}
+		sink = quads.size();
+		return frames;
+	});
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+// Microbenchmark of the ship part physics.
+//
+// Usage: bench_parts
+//
+// Compares, for a growing number of parts, the per-part loops over
+// std::vector<Vector2> and std::vector<bool> that MainState::updateTick() used
+// to run with ShipParts::gather() and shift(). Both must move the parts to
+// the same places.
+
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <lair/core/lair.h>
+
+#include "ship_parts.h"
+
+
+using namespace lair;
+
+
+enum {
+	TICKS = 1000,
+};
+
+
+struct OldParts {
+	std::vector<Vector2> pos;
+	std::vector<bool>    alive;
+};
+
+
+// The old gather and shift loops, without the collision in between.
+float oldTick(OldParts& parts, const std::vector<Vector2>& shape,
+              std::vector<Vector2>& partSpeeds, float maxSpeed) {
+	unsigned count = parts.pos.size();
+	for (unsigned i = 0 ; i < count ; ++i)
+	{
+		if (!parts.alive[i]) { continue; }
+
+		Vector2 gap = shape[i] - parts.pos[i];
+		float dist = gap.norm();
+		if (dist > maxSpeed)
+			gap *= maxSpeed / dist;
+
+		partSpeeds[i] = gap;
+	}
+
+	float magDrag = 0;
+	for (unsigned i = 0 ; i < count ; i++)
+		if (parts.alive[i])
+		{
+			parts.pos[i] += partSpeeds[i];
+			magDrag += partSpeeds[i][1];
+		}
+	return magDrag;
+}
+
+
+int main(int /*argc*/, char** /*argv*/) {
+	typedef std::chrono::steady_clock Clock;
+
+	bool ok = true;
+	for(unsigned count = 4; count <= 1024; count *= 4) {
+		std::mt19937 rand(count);
+		std::vector<Vector2> shapes[2];
+		std::vector<float>   shapeX[2];
+		std::vector<float>   shapeY[2];
+		for(unsigned s = 0; s < 2; ++s) {
+			for(unsigned i = 0; i < count; ++i) {
+				Vector2 p(int(rand() % 16) * 48 - 384, int(rand() % 16) * 48 - 384);
+				shapes[s].push_back(p);
+				shapeX[s].push_back(p(0));
+				shapeY[s].push_back(p(1));
+			}
+		}
+
+		OldParts oldParts;
+		ShipParts parts;
+		for(unsigned i = 0; i < count; ++i) {
+			bool alive = rand() % 8;
+			oldParts.pos.push_back(shapes[0][i]);
+			oldParts.alive.push_back(alive);
+			parts.x.push_back(shapes[0][i](0));
+			parts.y.push_back(shapes[0][i](1));
+			parts.alive.push_back(alive);
+		}
+		parts.vx.assign(count, 0);
+		parts.vy.assign(count, 0);
+
+		// Switch shape every 32 ticks, so parts are moving most of the time.
+		std::vector<Vector2> partSpeeds(count);
+		float oldDrag = 0;
+		Clock::time_point start = Clock::now();
+		for(unsigned t = 0; t < TICKS; ++t) {
+			unsigned s = (t / 32) % 2;
+			oldDrag += oldTick(oldParts, shapes[s], partSpeeds, 6);
+		}
+		Clock::time_point mid = Clock::now();
+		float drag = 0;
+		for(unsigned t = 0; t < TICKS; ++t) {
+			unsigned s = (t / 32) % 2;
+			parts.gather(shapeX[s].data(), shapeY[s].data(), 6);
+			drag += parts.shift();
+		}
+		Clock::time_point end = Clock::now();
+
+		float error = std::abs(drag - oldDrag);
+		for(unsigned i = 0; i < count; ++i) {
+			error = std::max(error, std::abs(parts.x[i] - oldParts.pos[i](0)));
+			error = std::max(error, std::abs(parts.y[i] - oldParts.pos[i](1)));
+		}
+		bool same = error < 1e-2;
+		ok = ok && same;
+
+		double oldTime = std::chrono::duration<double, std::nano>(mid - start).count()
+		               / TICKS;
+		double soaTime = std::chrono::duration<double, std::nano>(end - mid).count()
+		               / TICKS;
+		printf("%4u parts  old %8.1f ns/tick  soa %8.1f ns/tick (x%.1f, %.2f ns/part)%s\n",
+		       count, oldTime, soaTime, oldTime / soaTime, soaTime / count,
+		       same? "": "  MISMATCH");
+	}
+
+	return ok? EXIT_SUCCESS: EXIT_FAILURE;
+}
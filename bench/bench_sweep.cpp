@@ -0,0 +1,187 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// Microbenchmark of the ship collision tests against the map.
+//
+// Usage: bench_sweep
+//
+// Compares, for a growing distance travelled per tick, the scan of every
+// block in the swept column range (what MainState::collide() and collect()
+// used to do) with Map::sweepWall() and Map::pointsInRow(), on a synthetic
+// 100k-column map, with the boxes Simulation sweeps. Both must find the same
+// first wall and the same points. The old scan also skipped the blocks the
+// part went past during the tick, which the sweep hits on purpose: the scan
+// here does not, it checks the range.
+
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <lair/core/lair.h>
+
+#include "map.h"
+
+
+using namespace lair;
+
+
+enum {
+	LENGTH = 100000,
+	ROWS   = 22,
+};
+
+
+// The columns the old collide() and collect() scanned, for a part which left
+// side is at column x and was at x - dx at the previous tick.
+void scanRange(float x, float dx, int* begin, int* end) {
+	*begin = std::floor(x - dx);
+	*end   = int(x + 2);
+}
+
+
+// The box Simulation::sweptRow() sweeps by dx for the same part.
+Map::SweptBox sweptBox(float x, float dx) {
+	Map::SweptBox box = { x - dx, std::floor(x) + 1.5f - dx, INFINITY };
+	return box;
+}
+
+
+// Time of impact of the block scan, with the same convention as
+// Map::sweepWall(). Like the old collide(), it visits every block in the
+// swept range, so it is linear in dx.
+float scanWall(const Map& map, unsigned row, float x, float dx, int* col) {
+	int begin, end;
+	scanRange(x, dx, &begin, &end);
+	float x1 = sweptBox(x, dx).x1;
+	float toi = INFINITY;
+	for(int c = begin; c < end; ++c) {
+		if((map.wallMask(c) & (1u << row)) && toi == INFINITY) {
+			*col = c;
+			toi = (c < x1)? 0: (c - x1) / dx;
+		}
+	}
+	return toi;
+}
+
+
+void scanPoints(const Map& map, unsigned row, float x, float dx, std::vector<int>& cols) {
+	int begin, end;
+	scanRange(x, dx, &begin, &end);
+	cols.clear();
+	for(int c = begin; c < end; ++c) {
+		if(map.pointMask(c) & (1u << row))
+			cols.push_back(c);
+	}
+}
+
+
+// Like Simulation::collect().
+void sweepPoints(const Map& map, unsigned row, float x, float dx, std::vector<int>& cols) {
+	Map::SweptBox box = sweptBox(x, dx);
+	map.pointsInRow(row, std::floor(box.x0), std::ceil(box.x1 + dx), cols);
+	cols.erase(std::remove_if(cols.begin(), cols.end(),
+	                          [&](int c) { return c >= box.x1 + dx; }),
+	           cols.end());
+}
+
+
+struct Query {
+	float    x; // Left of the part, in columns.
+	unsigned row;
+};
+
+
+int main(int /*argc*/, char** /*argv*/) {
+	typedef std::chrono::steady_clock Clock;
+
+	// Roughly the density of the shipped segments: 10% walls, 3% points.
+	std::vector<uint32> walls (LENGTH);
+	std::vector<uint32> points(LENGTH);
+	std::mt19937 rand(42);
+	for(unsigned col = 0; col < LENGTH; ++col) {
+		for(unsigned row = 0; row < ROWS; ++row) {
+			unsigned r = rand() % 100;
+			if(r < 10)
+				walls [col] |= 1u << row;
+			else if(r < 13)
+				points[col] |= 1u << row;
+		}
+	}
+
+	Map map(nullptr, 48);
+	map.appendColumns(walls.data(), points.data(), LENGTH);
+	map.stream(0, LENGTH);
+
+	std::vector<Query> queries(100000);
+	std::mt19937 posRand(1);
+	for(Query& q: queries) {
+		// A part at a random place of the map.
+		q.x   = posRand() % (LENGTH - 8200) + 4100 + (posRand() % 100) / 100.f;
+		q.row = posRand() % ROWS;
+	}
+
+	bool ok = true;
+	std::vector<float> scanToi (queries.size());
+	std::vector<float> sweepToi(queries.size());
+	std::vector<int>   scanCol (queries.size(), -1);
+	std::vector<int>   sweepCol(queries.size(), -1);
+	std::vector<int>   scanPointCols;
+	std::vector<int>   sweepPointCols;
+
+	// Not whole columns, like most ticks.
+	for(float dx = 1.3; dx <= 4096; dx *= 4) {
+		Clock::time_point start = Clock::now();
+		for(unsigned i = 0; i < queries.size(); ++i) {
+			const Query& q = queries[i];
+			scanToi[i] = scanWall(map, q.row, q.x, dx, &scanCol[i]);
+		}
+		Clock::time_point mid = Clock::now();
+		for(unsigned i = 0; i < queries.size(); ++i) {
+			const Query& q = queries[i];
+			Map::SweptBox box = sweptBox(q.x, dx);
+			sweepToi[i] = map.sweepWall(q.row, box.x0, box.x1, dx, &sweepCol[i]);
+		}
+		Clock::time_point end = Clock::now();
+
+		bool same = (scanToi == sweepToi && scanCol == sweepCol);
+		for(unsigned i = 0; i < queries.size() && same; ++i) {
+			const Query& q = queries[i];
+			scanPoints (map, q.row, q.x, dx, scanPointCols);
+			sweepPoints(map, q.row, q.x, dx, sweepPointCols);
+			same = (scanPointCols == sweepPointCols);
+		}
+		ok = ok && same;
+
+		double scanTime  = std::chrono::duration<double, std::nano>(mid - start).count()
+		                 / queries.size();
+		double sweepTime = std::chrono::duration<double, std::nano>(end - mid).count()
+		                 / queries.size();
+		printf("dx %6.1f columns/tick  scan %9.1f ns  sweep %6.1f ns (x%.1f)%s\n",
+		       dx, scanTime, sweepTime, scanTime / sweepTime, same? "": "  MISMATCH");
+	}
+
+	return ok? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,188 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <atomic>
+
+#include "parallel.h"
+
+#include "batch_simulation.h"
+
+
+uint8 randomBot(const Simulation& sim, uint8 buttons, std::minstd_rand& rng) {
+	static const uint8 steering[] = {
+		0,
+		SimInput::CLIMB,
+		SimInput::DIVE,
+		SimInput::STRETCH,
+		SimInput::SHRINK,
+	};
+
+	// Only use the raw engine output, whose sequence is standard, so that
+	// runs are the same with every standard library.
+	double p = 4. * double(sim.tickDuration()) / double(ONE_SEC);
+	if(buttons && rng() - rng.min() >= p * (rng.max() - rng.min()))
+		return buttons;
+	return SimInput::ACCEL | steering[rng() % (sizeof(steering) / sizeof(*steering))];
+}
+
+
+BatchSimulation::BatchSimulation(float blockSize)
+    : _blockSize(blockSize),
+      _tickDuration(ONE_SEC / 60) {
+}
+
+
+BatchSimulation::~BatchSimulation() {
+}
+
+
+void BatchSimulation::setTickDuration(int64 tickDuration) {
+	_tickDuration = tickDuration;
+}
+
+
+bool BatchSimulation::loadLevels(const Path& dataPath, const Json::Value& maps, Logger& log) {
+	unsigned nRows = Map(nullptr, _blockSize).rowCount();
+
+	_levels.clear();
+	_levels.resize(maps.size());
+	unsigned loaded = 0;
+	for(unsigned li = 0; li < maps.size(); ++li) {
+		const Json::Value& info = maps[li];
+		Level& level = _levels[li];
+		level.header = nullptr;
+		if(info.isMember("generate")) {
+			log.warning("Level ", li, " is generated, skip it.");
+			continue;
+		}
+
+		Path shipPath = info.get("ship", "ship_default.json").asString();
+		Json::Value shipJson;
+		if(!parseJson(shipJson, dataPath / shipPath, shipPath, log)
+		|| !level.shipDef.load(shipJson, _blockSize, log)) {
+			log.error("Failed to load ship \"", shipPath, "\" of level ", li, ".");
+			continue;
+		}
+
+		Path levelPath = buildDataPath(dataPath) / Path(levelFilePath(li));
+		level.file.reset(new MappedFile);
+		if(level.file->open(levelPath)) {
+			level.header = checkLevelFile(level.file->data(), level.file->size(), nRows,
+			                              hashSegments(info["segments"], dataPath), levelPath);
+		}
+		if(!level.header) {
+			log.error("No up to date \"", levelPath, "\", build the levels target.");
+			level.file.reset();
+			continue;
+		}
+		++loaded;
+	}
+
+	return loaded != 0;
+}
+
+
+bool BatchSimulation::hasLevel(unsigned level) const {
+	return level < _levels.size() && _levels[level].header;
+}
+
+
+int BatchSimulation::levelLength(unsigned level) const {
+	lairAssert(hasLevel(level));
+	return _levels[level].header->length;
+}
+
+
+unsigned BatchSimulation::levelPointCount(unsigned level) const {
+	lairAssert(hasLevel(level));
+	const LevelFileHeader* header = _levels[level].header;
+	const uint32* points = levelPoints(header);
+	unsigned count = 0;
+	for(unsigned col = 0; col < header->length; ++col) {
+		for(uint32 mask = points[col]; mask; mask &= mask - 1)
+			++count;
+	}
+	return count;
+}
+
+
+const ShipDef& BatchSimulation::shipDef(unsigned level) const {
+	lairAssert(hasLevel(level));
+	return _levels[level].shipDef;
+}
+
+
+void BatchSimulation::resetMap(unsigned level, Map& map) const {
+	lairAssert(hasLevel(level));
+	const LevelFileHeader* header = _levels[level].header;
+	map.clear();
+	map.appendColumns(levelWalls(header), levelPoints(header), header->length);
+}
+
+
+void BatchSimulation::run(const std::vector<SimRun>& runs,
+                          std::vector<SimRunResult>& results) const {
+	results.resize(runs.size());
+
+	// Runs are handed out one at a time to a worker per thread, which keeps
+	// its map and simulation from one run to the next.
+	std::atomic<unsigned> next(0);
+	parallelFor(workerCount(), [&](unsigned) {
+		Map map(nullptr, _blockSize);
+		Simulation sim(&map, _blockSize);
+		sim.setTickDuration(_tickDuration);
+		for(unsigned i = next++; i < runs.size(); i = next++)
+			results[i] = runOne(runs[i], map, sim);
+	});
+}
+
+
+SimRunResult BatchSimulation::runOne(const SimRun& run, Map& map, Simulation& sim) const {
+	lairAssert(hasLevel(run.level));
+	lairAssert(run.script || run.bot);
+	lairAssert(sim.map() == &map && sim.tickDuration() == _tickDuration);
+
+	resetMap(run.level, map);
+	sim.start(_levels[run.level].shipDef);
+	sim.streamMap();
+
+	std::minstd_rand rng(run.seed);
+	const SimState& state = sim.state();
+	uint8 buttons = 0;
+	while(state.isAlive() && !sim.isFinished() && state.ticks < run.maxTicks) {
+		SimInput input;
+		input.buttons = run.script? run.script->buttons(state.ticks):
+		                            run.bot(sim, buttons, rng);
+		input.pressed = input.buttons & ~buttons;
+		buttons = input.buttons;
+		sim.tick(input);
+	}
+
+	SimRunResult result;
+	result.score       = state.score;
+	result.distance    = state.distance;
+	result.deathColumn = state.isAlive()? -1:
+	                     int((state.scrollPos + state.shipPos(0)) / _blockSize);
+	result.ticks       = state.ticks;
+	result.finished    = state.isAlive() && sim.isFinished();
+	return result;
+}
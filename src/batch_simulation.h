@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_BATCH_SIMULATION_H
+#define _LD35_BATCH_SIMULATION_H
+
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+#include <lair/core/json.h>
+
+#include "mapped_file.h"
+#include "level_file.h"
+#include "input_script.h"
+#include "ship_parts.h"
+#include "simulation.h"
+
+
+using namespace lair;
+
+
+// Chooses the buttons held during a tick, given the ones held during the
+// previous tick. rng is seeded with SimRun::seed.
+typedef std::function<uint8(const Simulation& sim, uint8 buttons,
+                            std::minstd_rand& rng)> SimBot;
+
+// Holds accel and changes its steering (or shape) at random, about four
+// times per second.
+uint8 randomBot(const Simulation& sim, uint8 buttons, std::minstd_rand& rng);
+
+
+// A level played from its start, until the ship crashes, reaches the end or
+// maxTicks ticks pass. It follows script if it is set, bot otherwise.
+struct SimRun {
+	unsigned           level;
+	const InputScript* script;
+	SimBot             bot;
+	uint32             seed;
+	unsigned           maxTicks;
+};
+
+struct SimRunResult {
+	float    score;
+	float    distance;
+	int      deathColumn; // Where the ship crashed, -1 if it did not.
+	unsigned ticks;
+	bool     finished;
+};
+
+
+// Plays many independent runs on every core, without a window. The levels
+// of maps.json are loaded once and shared read-only; each thread has its own
+// Map (with the points picked up) and Simulation, reset from run to run, so
+// that runs do not depend on each other nor on the number of threads.
+// Generated levels are not supported: they need the game asset loader.
+class BatchSimulation {
+public:
+	BatchSimulation(float blockSize);
+	BatchSimulation(const BatchSimulation&) = delete;
+	~BatchSimulation();
+
+	BatchSimulation& operator=(const BatchSimulation&) = delete;
+
+	void setTickDuration(int64 tickDuration);
+	int64 tickDuration() const { return _tickDuration; }
+
+	// Load the compiled levels of maps.json and their ships, from dataPath.
+	// Levels that fail to load are skipped; returns false if none loaded.
+	bool loadLevels(const Path& dataPath, const Json::Value& maps, Logger& log);
+
+	unsigned levelCount() const { return _levels.size(); }
+	bool hasLevel(unsigned level) const;
+	int levelLength(unsigned level) const;
+	unsigned levelPointCount(unsigned level) const;
+	const ShipDef& shipDef(unsigned level) const;
+
+	// Make map a fresh copy of level, that shares its columns.
+	void resetMap(unsigned level, Map& map) const;
+
+	// Play runs on up to workerCount() threads and set results[i] to the
+	// result of runs[i].
+	void run(const std::vector<SimRun>& runs, std::vector<SimRunResult>& results) const;
+
+	// Play a run on the calling thread, with the given map and simulation.
+	SimRunResult runOne(const SimRun& run, Map& map, Simulation& sim) const;
+
+private:
+	struct Level {
+		ShipDef                     shipDef;
+		std::unique_ptr<MappedFile> file;
+		const LevelFileHeader*      header; // Null if the level is not available.
+	};
+
+private:
+	float              _blockSize;
+	int64              _tickDuration;
+	std::vector<Level> _levels;
+};
+
+
+#endif
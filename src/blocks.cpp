@@ -0,0 +1,205 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#define LD35_CLASSIFY_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LD35_CLASSIFY_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "blocks.h"
+
+
+// Pixels are compared on their RGB bytes, read as a little-endian uint32
+// with alpha (or the next pixel) masked out.
+#define RGB_MASK    0x00ffffffu
+#define WALL_COLOR  0x00000000u
+#define POINT_COLOR 0x0000ff00u
+
+
+inline uint32 loadRgb(const uint8* pixel) {
+	return uint32(pixel[0]) | (uint32(pixel[1]) << 8) | (uint32(pixel[2]) << 16);
+}
+
+
+// Classify count pixels of a row, or-ing bit in the masks of matching
+// columns.
+void classifyRowScalar(const uint8* pixels, unsigned pxSize, unsigned count,
+                       uint32 bit, uint32* walls, uint32* points) {
+	for(unsigned i = 0; i < count; ++i) {
+		uint32 rgb = loadRgb(pixels + i * pxSize);
+		walls [i] |= (rgb == WALL_COLOR)?  bit: 0;
+		points[i] |= (rgb == POINT_COLOR)? bit: 0;
+	}
+}
+
+
+#if defined(LD35_CLASSIFY_SSE2) || defined(LD35_CLASSIFY_AVX2)
+
+inline uint32 loadUint32(const uint8* p) {
+	uint32 v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+// Or bit into the masks of 4 columns depending on 4 pixels (one per lane).
+inline void classify4(__m128i rgb, __m128i bit, uint32* walls, uint32* points) {
+	rgb = _mm_and_si128(rgb, _mm_set1_epi32(RGB_MASK));
+	__m128i isWall  = _mm_cmpeq_epi32(rgb, _mm_set1_epi32(WALL_COLOR));
+	__m128i isPoint = _mm_cmpeq_epi32(rgb, _mm_set1_epi32(POINT_COLOR));
+
+	__m128i* w = reinterpret_cast<__m128i*>(walls);
+	__m128i* p = reinterpret_cast<__m128i*>(points);
+	_mm_storeu_si128(w, _mm_or_si128(_mm_loadu_si128(w), _mm_and_si128(isWall,  bit)));
+	_mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p), _mm_and_si128(isPoint, bit)));
+}
+
+#endif
+
+
+#if defined(LD35_CLASSIFY_AVX2)
+
+// Or bit into the masks of 8 columns depending on 8 pixels (one per lane).
+inline void classify8(__m256i rgb, __m256i bit, uint32* walls, uint32* points) {
+	rgb = _mm256_and_si256(rgb, _mm256_set1_epi32(RGB_MASK));
+	__m256i isWall  = _mm256_cmpeq_epi32(rgb, _mm256_set1_epi32(WALL_COLOR));
+	__m256i isPoint = _mm256_cmpeq_epi32(rgb, _mm256_set1_epi32(POINT_COLOR));
+
+	__m256i* w = reinterpret_cast<__m256i*>(walls);
+	__m256i* p = reinterpret_cast<__m256i*>(points);
+	_mm256_storeu_si256(w, _mm256_or_si256(_mm256_loadu_si256(w), _mm256_and_si256(isWall,  bit)));
+	_mm256_storeu_si256(p, _mm256_or_si256(_mm256_loadu_si256(p), _mm256_and_si256(isPoint, bit)));
+}
+
+
+void classifyRow(const uint8* pixels, unsigned pxSize, unsigned count,
+                 uint32 bit, uint32* walls, uint32* points) {
+	__m256i bit8 = _mm256_set1_epi32(bit);
+	unsigned i = 0;
+	if(pxSize == 4) {
+		for(; i + 8 <= count; i += 8) {
+			__m256i rgba = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i * 4));
+			classify8(rgba, bit8, walls + i, points + i);
+		}
+	}
+	else {
+		// Spread 4 packed RGB pixels into 4 lanes in each 128-bit half. The
+		// second half is loaded 12 bytes after the first one, so 28 bytes are
+		// read for 8 pixels: stop 10 pixels before the end.
+		const __m256i spread = _mm256_setr_epi8(
+		        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		for(; i + 10 <= count; i += 8) {
+			const uint8* p = pixels + i * 3;
+			__m256i rgb = _mm256_inserti128_si256(
+			        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+			        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+			classify8(_mm256_shuffle_epi8(rgb, spread), bit8, walls + i, points + i);
+		}
+	}
+	classifyRowScalar(pixels + i * pxSize, pxSize, count - i, bit, walls + i, points + i);
+}
+
+
+const char* classifyKernelName() {
+	return "avx2";
+}
+
+#elif defined(LD35_CLASSIFY_SSE2)
+
+void classifyRow(const uint8* pixels, unsigned pxSize, unsigned count,
+                 uint32 bit, uint32* walls, uint32* points) {
+	__m128i bit4 = _mm_set1_epi32(bit);
+	unsigned i = 0;
+	if(pxSize == 4) {
+		for(; i + 4 <= count; i += 4) {
+			__m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+			classify4(rgba, bit4, walls + i, points + i);
+		}
+	}
+	else {
+		// Each 4-byte load reads the first byte of the next pixel, so the
+		// last pixel is left to the scalar loop.
+		for(; i + 4 < count; i += 4) {
+			const uint8* p = pixels + i * 3;
+			__m128i rgb = _mm_setr_epi32(loadUint32(p),     loadUint32(p + 3),
+			                             loadUint32(p + 6), loadUint32(p + 9));
+			classify4(rgb, bit4, walls + i, points + i);
+		}
+	}
+	classifyRowScalar(pixels + i * pxSize, pxSize, count - i, bit, walls + i, points + i);
+}
+
+
+const char* classifyKernelName() {
+	return "sse2";
+}
+
+#else
+
+void classifyRow(const uint8* pixels, unsigned pxSize, unsigned count,
+                 uint32 bit, uint32* walls, uint32* points) {
+	classifyRowScalar(pixels, pxSize, count, bit, walls, points);
+}
+
+
+const char* classifyKernelName() {
+	return "scalar";
+}
+
+#endif
+
+
+void classifyColumns(const uint8* pixels, unsigned pxSize, unsigned stride,
+                     unsigned width, unsigned height,
+                     unsigned first, unsigned count,
+                     uint32* walls, uint32* points) {
+	lairAssert(first + count <= width);
+	lairAssert(pxSize == 3 || pxSize == 4);
+	std::fill(walls,  walls  + count, 0);
+	std::fill(points, points + count, 0);
+	for(unsigned frow = 0; frow < height; ++frow) {
+		uint32 bit = 1u << (height - frow - 1); // vertical flip
+		classifyRow(pixels + frow * stride + first * pxSize, pxSize, count,
+		            bit, walls, points);
+	}
+}
+
+
+void classifyColumnsScalar(const uint8* pixels, unsigned pxSize, unsigned stride,
+                           unsigned width, unsigned height,
+                           unsigned first, unsigned count,
+                           uint32* walls, uint32* points) {
+	lairAssert(first + count <= width);
+	lairAssert(pxSize == 3 || pxSize == 4);
+	std::fill(walls,  walls  + count, 0);
+	std::fill(points, points + count, 0);
+	for(unsigned frow = 0; frow < height; ++frow) {
+		uint32 bit = 1u << (height - frow - 1); // vertical flip
+		classifyRowScalar(pixels + frow * stride + first * pxSize, pxSize, count,
+		                  bit, walls, points);
+	}
+}
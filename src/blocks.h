@@ -0,0 +1,54 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _LD35_BLOCKS_H
+#define _LD35_BLOCKS_H
+
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+// Extract the wall (black) and point (green) masks of count columns of an
+// image, starting at column first. Bit n of a mask is set if there is a
+// block in row n, counting rows from the bottom of the image. stride is the
+// size of an image row in bytes and pxSize the size of a pixel (3 or 4).
+//
+// Rows are processed in memory order with the best kernel available at
+// compile time (AVX2, SSE2 or scalar).
+void classifyColumns(const uint8* pixels, unsigned pxSize, unsigned stride,
+                     unsigned width, unsigned height,
+                     unsigned first, unsigned count,
+                     uint32* walls, uint32* points);
+
+// Same as classifyColumns(), but always uses the portable scalar kernel.
+void classifyColumnsScalar(const uint8* pixels, unsigned pxSize, unsigned stride,
+                           unsigned width, unsigned height,
+                           unsigned first, unsigned count,
+                           uint32* walls, uint32* points);
+
+// Name of the kernel used by classifyColumns().
+const char* classifyKernelName();
+
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <cstring>
+
+#ifdef SHAPEOUT_COUNT_DRAWS
+#include <lair/render_gl2/gl.h>
+#endif
+
+#include "draw_call_counter.h"
+
+
+namespace {
+
+// GL is only called from the main thread.
+uint64 drawCount  = 0;
+bool   drawHooked = false;
+
+#ifdef SHAPEOUT_COUNT_DRAWS
+
+#if defined(_WIN32) && !defined(_WIN64)
+#define GL_CALL __stdcall
+#else
+#define GL_CALL
+#endif
+
+typedef void (GL_CALL *DrawArraysProc)  (GLenum, GLint, GLsizei);
+typedef void (GL_CALL *DrawElementsProc)(GLenum, GLsizei, GLenum, const void*);
+
+DrawArraysProc   realDrawArrays   = nullptr;
+DrawElementsProc realDrawElements = nullptr;
+
+void GL_CALL countDrawArrays(GLenum mode, GLint first, GLsizei count) {
+	++drawCount;
+	realDrawArrays(mode, first, count);
+}
+
+void GL_CALL countDrawElements(GLenum mode, GLsizei count, GLenum type,
+                               const void* indices) {
+	++drawCount;
+	realDrawElements(mode, count, type, indices);
+}
+
+#endif
+
+}
+
+
+#ifdef SHAPEOUT_COUNT_DRAWS
+
+// Linked in place of SDL_GL_GetProcAddress() with -Wl,--wrap.
+extern "C" void* __real_SDL_GL_GetProcAddress(const char* proc);
+
+extern "C" void* __wrap_SDL_GL_GetProcAddress(const char* proc) {
+	void* func = __real_SDL_GL_GetProcAddress(proc);
+	if(!func)
+		return func;
+
+	if(std::strcmp(proc, "glDrawArrays") == 0) {
+		realDrawArrays = reinterpret_cast<DrawArraysProc>(func);
+		drawHooked = true;
+		return reinterpret_cast<void*>(&countDrawArrays);
+	}
+	if(std::strcmp(proc, "glDrawElements") == 0) {
+		realDrawElements = reinterpret_cast<DrawElementsProc>(func);
+		drawHooked = true;
+		return reinterpret_cast<void*>(&countDrawElements);
+	}
+	return func;
+}
+
+#endif
+
+
+DrawCallCounter::DrawCallCounter()
+	: _frameBegin(0),
+	  _frameDrawCalls(0),
+	  _totalDrawCalls(0),
+	  _frameCount(0) {
+}
+
+
+bool DrawCallCounter::isAvailable() {
+	return drawHooked;
+}
+
+
+void DrawCallCounter::beginFrame() {
+	_frameBegin = drawCount;
+}
+
+
+void DrawCallCounter::endFrame() {
+	_frameDrawCalls  = drawCount - _frameBegin;
+	_totalDrawCalls += _frameDrawCalls;
+	++_frameCount;
+}
+
+
+float DrawCallCounter::average() const {
+	return _frameCount? float(_totalDrawCalls) / float(_frameCount): 0;
+}
+
+
+void DrawCallCounter::resetAverage() {
+	_totalDrawCalls = 0;
+	_frameCount     = 0;
+}
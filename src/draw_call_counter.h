@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_DRAW_CALL_COUNTER_H
+#define _LD35_DRAW_CALL_COUNTER_H
+
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+// Count the draw calls of a frame, that is the calls to glDrawArrays and
+// glDrawElements, whoever makes them (the SpriteRenderer, the tile renderers
+// or lair's components). The game is linked with SDL_GL_GetProcAddress()
+// wrapped (see SHAPEOUT_COUNT_DRAWS in src/CMakeLists.txt), so that the GL
+// context gets counting versions of these two functions. Where the linker can
+// not wrap it, isAvailable() is false and nothing is counted.
+class DrawCallCounter {
+public:
+	DrawCallCounter();
+
+	static bool isAvailable();
+
+	void beginFrame();
+	void endFrame();
+
+	unsigned frameDrawCalls() const { return _frameDrawCalls; }
+
+	// Draw calls per frame since the last call to resetAverage().
+	float average() const;
+	void resetAverage();
+
+private:
+	uint64   _frameBegin;
+	unsigned _frameDrawCalls;
+	uint64   _totalDrawCalls;
+	unsigned _frameCount;
+};
+
+
+#endif
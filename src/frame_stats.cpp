@@ -0,0 +1,103 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <cstdio>
+
+#include "frame_stats.h"
+
+
+FrameStats::FrameStats()
+    : _maxFrameDuration(0) {
+	reset();
+}
+
+
+void FrameStats::reset() {
+	for(LatencyHistogram& histogram: _histograms)
+		histogram.reset();
+	_loopStart = 0;
+	_lastFrame = -1;
+	_lateTicks = 0;
+}
+
+
+void FrameStats::setMaxFrameDuration(int64 duration) {
+	_maxFrameDuration = duration;
+}
+
+
+// The histograms are kept from a run of the state to the next, but not the
+// frame intervals: there is a loading time in between.
+void FrameStats::startLoop(int64 now) {
+	_loopStart = now;
+	_lastFrame = -1;
+}
+
+
+void FrameStats::frame(int64 now) {
+	if(_lastFrame >= 0)
+		_histograms[FRAME].record(now - _lastFrame);
+	_lastFrame = now;
+}
+
+
+void FrameStats::tick(int64 begin, int64 end, uint64 tickTime) {
+	int64 lateness = begin - _loopStart - int64(tickTime);
+	_histograms[TICK].record(end - begin);
+	_histograms[TICK_LATENESS].record(lateness);
+	if(lateness > _maxFrameDuration)
+		++_lateTicks;
+}
+
+
+void FrameStats::swap(int64 begin, int64 end) {
+	_histograms[SWAP].record(end - begin);
+}
+
+
+const char* FrameStats::metricName(Metric metric) {
+	static const char* names[] = {
+		"frame",
+		"tick",
+		"swap",
+		"tick lateness",
+	};
+	return names[metric];
+}
+
+
+std::string FrameStats::report() const {
+	std::string report;
+	char line[160];
+	for(int m = 0; m < METRIC_COUNT; ++m) {
+		const LatencyHistogram& h = _histograms[m];
+		snprintf(line, sizeof(line),
+		         "%-13s  p50 %6.2f  p95 %6.2f  p99 %6.2f  max %7.2f ms  (%llu)\n",
+		         metricName(Metric(m)), h.percentile(50) / 1e6, h.percentile(95) / 1e6,
+		         h.percentile(99) / 1e6, h.max() / 1e6, (unsigned long long)h.count());
+		report += line;
+	}
+	snprintf(line, sizeof(line), "late ticks     %llu (behind by more than %.2f ms)\n",
+	         (unsigned long long)_lateTicks, _maxFrameDuration / 1e6);
+	report += line;
+	return report;
+}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_FRAME_STATS_H
+#define _LD35_FRAME_STATS_H
+
+
+#include <string>
+
+#include <lair/core/lair.h>
+
+#include "latency_histogram.h"
+
+
+using namespace lair;
+
+
+// The latency histograms of the main loop of a game state. Times are from
+// SysModule::getTimeNs().
+class FrameStats {
+public:
+	enum Metric {
+		FRAME,         // From a frame to the next one.
+		TICK,          // Spent in updateTick().
+		SWAP,          // Spent in Window::swapBuffers().
+		TICK_LATENESS, // How late ticks run after their InterpLoop::tickTime().
+		METRIC_COUNT
+	};
+
+public:
+	FrameStats();
+
+	void reset();
+
+	// Ticks later than the InterpLoop max frame duration are counted as late:
+	// that is when the loop falls behind.
+	void setMaxFrameDuration(int64 duration);
+	// Call right after InterpLoop::start().
+	void startLoop(int64 now);
+	void frame(int64 now);
+	void tick(int64 begin, int64 end, uint64 tickTime);
+	void swap(int64 begin, int64 end);
+
+	const LatencyHistogram& histogram(Metric metric) const { return _histograms[metric]; }
+	uint64 lateTicks() const { return _lateTicks; }
+
+	static const char* metricName(Metric metric);
+
+	// A line per metric with its p50, p95, p99 and max in milliseconds.
+	std::string report() const;
+
+private:
+	LatencyHistogram _histograms[METRIC_COUNT];
+	int64            _loopStart;
+	int64            _lastFrame;
+	int64            _maxFrameDuration;
+	uint64           _lateTicks;
+};
+
+
+#endif
@@ -19,16 +19,39 @@
  */
 
 
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
 #include "main_state.h"
 #include "splash_state.h"
 
 #include "game.h"
 
 
+#define FRAME_STATS_FILE "frame_stats.txt"
+
+
 Game::Game(int argc, char** argv)
     : GameBase(argc, argv),
       _mainState(),
-      _splashState() {
+      _splashState(),
+      _tickRate(0),
+      _endless(false),
+      _endlessSeed(0) {
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if(arg == "--tick-rate" && i + 1 < argc)
+			_tickRate = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--record" && i + 1 < argc)
+			_recordPath = argv[++i];
+		else if(arg == "--replay" && i + 1 < argc)
+			_replayPath = argv[++i];
+		else if(arg == "--endless" && i + 1 < argc) {
+			_endless     = true;
+			_endlessSeed = std::strtoul(argv[++i], nullptr, 10);
+		}
+	}
 }
 
 
@@ -58,6 +81,8 @@ void Game::initialize() {
 
 
 void Game::shutdown() {
+	writeFrameStats();
+
 	_mainState->shutdown();
 	_splashState->shutdown();
 
@@ -69,6 +94,17 @@ void Game::shutdown() {
 }
 
 
+void Game::writeFrameStats() {
+	std::ofstream out(FRAME_STATS_FILE);
+	out << "Main state\n" << _mainState->frameStats().report()
+	    << "\nSplash state\n" << _splashState->frameStats().report();
+	if(!out)
+		_mainState->log().error("Failed to write \"" FRAME_STATS_FILE "\".");
+	else
+		_mainState->log().info("Wrote frame stats to \"" FRAME_STATS_FILE "\".");
+}
+
+
 MainState* Game::mainState() {
 	return _mainState.get();
 }
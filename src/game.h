@@ -45,14 +45,31 @@ public:
 
 	void initialize();
 	void shutdown();
+	// Write the latency histograms of the states to FRAME_STATS_FILE.
+	void writeFrameStats();
 
 	MainState* mainState();
 	SplashState* splashState();
 
+	// Options given on the command line.
+	unsigned tickRate() const { return _tickRate; } // 0 if not set.
+	const Path& recordPath() const { return _recordPath; }
+	const Path& replayPath() const { return _replayPath; }
+	// Play the endless level of endless.json, generated from the seed,
+	// instead of maps.json.
+	bool endless() const { return _endless; }
+	unsigned endlessSeed() const { return _endlessSeed; }
+
 protected:
 	std::unique_ptr<SplashState> _splashState;
 // 	std::unique_ptr<MainState> _mainmenuState;
 	std::unique_ptr<MainState> _mainState;
+
+	unsigned _tickRate;
+	Path     _recordPath;
+	Path     _replayPath;
+	bool     _endless;
+	unsigned _endlessSeed;
 };
 
 
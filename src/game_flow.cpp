@@ -0,0 +1,283 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+
+#include "level_file.h"
+#include "profiler.h"
+
+#include "game_flow.h"
+
+
+const float GameFlow::ANIM_STEP_LENGTH = .4;
+
+
+GameFlow::GameFlow(Map* map, Simulation* sim, float blockSize)
+	: _map(map),
+      _sim(sim),
+      _blockSize(blockSize),
+      _listener(nullptr),
+      _log(&dbgLogger),
+      _maps(Json::arrayValue),
+      _level(0),
+      _levelFinished(false),
+      _pause(false),
+      _mapAnimIndex(0),
+      _animStep(-1),
+      _animState(ANIM_NONE),
+      _animPos(0),
+      _animLength(-1),
+      _inputs(0),
+      _prevInputs(0),
+      _hash(SIM_HASH_SEED) {
+}
+
+
+void GameFlow::setup(const Path& dataPath, const Json::Value& maps,
+                     const Json::Value& animations, Logger& log) {
+	_dataPath   = dataPath;
+	_maps       = maps;
+	_animations = animations;
+	_log        = &log;
+}
+
+
+bool GameFlow::startLevel(int level) {
+	PROFILE_ZONE("GameFlow::startLevel");
+	lairAssert(levelCount() > 0);
+
+	_level = level % levelCount();
+	_pause = false;
+	_levelFinished = false;
+
+	const Json::Value& info = levelInfo();
+	const Json::Value& mapAnims = info["anims"];
+	_mapAnims.clear();
+	for(int i = 0; i < mapAnims.size(); ++i) {
+		_mapAnims.push_back(std::make_pair(mapAnims[i][0].asInt(),
+		                                   mapAnims[i][1].asString()));
+	}
+	_mapAnimIndex = 0;
+
+	Path shipPath = info.get("ship", "ship_default.json").asString();
+	Json::Value shipJson;
+	if(!parseJson(shipJson, _dataPath / shipPath, shipPath, *_log)
+	|| !_shipDef.load(shipJson, _blockSize, *_log))
+		_log->error("Failed to load ship \"", shipPath, "\"");
+
+	_sim->start(_shipDef);
+	bool ok = loadMap();
+	_sim->streamMap();
+
+	_animState = ANIM_NONE;
+
+	if(_listener)
+		_listener->levelStarted();
+	return ok;
+}
+
+
+unsigned GameFlow::tick(uint8 inputs) {
+	_prevInputs = _inputs;
+	_inputs     = inputs;
+
+	if(justPressed(REC_RESTART))
+		startLevel((_level + 1) % levelCount());
+
+	const SimState& state = _sim->state();
+	bool alive = state.isAlive();
+	_sim->tickDeathTimer();
+
+	if(alive && _animState == ANIM_NONE && _mapAnimIndex < _mapAnims.size()
+	&& int(state.scrollPos) >= _mapAnims[_mapAnimIndex].first) {
+		playAnimation(_mapAnims[_mapAnimIndex].second);
+		++_mapAnimIndex;
+	}
+
+	bool levelFinished = _sim->isFinished();
+	bool levelSucceded = state.score >= levelInfo().get("min_score", 0).asFloat();
+	if(alive && _animState == ANIM_NONE && levelFinished && !_levelFinished) {
+		std::string anim = levelInfo()
+		        .get(levelSucceded? "end_anim": "fail_anim", "").asString();
+		if(!anim.empty())
+			playAnimation(anim);
+	}
+	_levelFinished = levelFinished;
+
+	if(justPressed(REC_SKIP))
+		endAnimation();
+
+	// Animations are updated with the ticks, so that they pause the game for
+	// the same number of ticks when it is replayed.
+	updateAnimation(double(_sim->tickDuration()) / double(ONE_SEC));
+
+	if(_pause)
+		return 0;
+
+	if(alive && _levelFinished) {
+		int next = _level + levelSucceded;
+		if(next >= levelCount())
+			return FLOW_GAME_OVER;
+
+		startLevel(next);
+		return 0;
+	}
+
+	if(state.deathTimer > int64(ONE_SEC)) {
+		startLevel(_level);
+		return 0;
+	}
+
+	uint8 simButtons = (1 << (REC_SHRINK + 1)) - 1;
+	SimInput input;
+	input.buttons = _inputs & simButtons;
+	input.pressed = _inputs & ~_prevInputs & simButtons;
+
+	unsigned events = _sim->tick(input);
+	_hash = hashSimState(_sim->state(), _hash);
+	return events | FLOW_TICKED;
+}
+
+
+void GameFlow::resetHash() {
+	_hash = SIM_HASH_SEED;
+}
+
+
+bool GameFlow::justPressed(RecordedInput input) const {
+	return (_inputs & ~_prevInputs) & (1 << input);
+}
+
+
+bool GameFlow::loadMap() {
+	const Json::Value& info = levelInfo();
+	const Json::Value& generate = info["generate"];
+	if(generate.isObject()) {
+		if(!_map->hasLoader()) {
+			_log->error("Level ", _level, " is generated, which needs the images");
+			_map->clear();
+			return false;
+		}
+		_map->generate(generate.get("seed", 0).asUInt(),
+		               generate.get("length", 0).asUInt(),
+		               generate.get("difficulty", 0).asFloat(),
+		               generate.get("variance", .3).asFloat());
+		return true;
+	}
+
+	// Use the compiled level if it is there and up to date, and fall back to
+	// the segment images otherwise.
+	const Json::Value& segments = info["segments"];
+	Path levelPath = buildDataPath(_dataPath) / Path(levelFilePath(_level));
+	if(_map->loadCompiled(levelPath, hashSegments(segments, _dataPath)))
+		return true;
+
+	_map->clear();
+	if(!_map->hasLoader()) {
+		_log->error("No up to date \"", levelPath, "\", build the levels target");
+		return false;
+	}
+	std::vector<Path> paths;
+	for(int i = 0; i < segments.size(); ++i) {
+		Path path = segments[i].asString();
+		if(!path.empty()) {
+			paths.push_back(path);
+		}
+	}
+	_map->appendSections(paths);
+	return true;
+}
+
+
+void GameFlow::playAnimation(const std::string& name) {
+	if(_animations.isMember(name) && _animations[name].isArray()) {
+		_animCurrent = name;
+		_animStep = -1;
+		nextAnimationStep();
+	}
+	else {
+		_log->error("Unable to play animation \"", name,"\".");
+	}
+}
+
+
+void GameFlow::updateAnimation(float time) {
+	if(_animLength >= 0) {
+		_animPos += time;
+		if(_listener)
+			_listener->animationUpdate(_animPos);
+	}
+	if(_animState == ANIM_PLAY && (_animLength < 0 || _animPos > _animLength)) {
+		nextAnimationStep();
+	}
+}
+
+
+void GameFlow::nextAnimationStep() {
+	const Json::Value& stepList = _animations[_animCurrent];
+	lairAssert(stepList.isArray());
+
+	++_animStep;
+	_animLength = -1;
+	_animState = ANIM_NONE;
+	_pause = false;
+	const Json::Value* step = nullptr;
+	if(_animStep < int(stepList.size())) {
+		try {
+			const Json::Value& s = stepList[_animStep];
+			if(s.isArray()) {
+				const std::string& cmd = s[0].asString();
+				_animPos = 0;
+				_animState = ANIM_PLAY;
+				_pause = true;
+				if(cmd == "show_char" || cmd == "hide_char" || cmd == "end_dialog")
+					_animLength = ANIM_STEP_LENGTH;
+				if(cmd == "show_text")
+					_animState = ANIM_WAIT;
+				step = &s;
+			}
+			else
+				_log->error("Animation ", _animCurrent, ":", _animStep, " is not an array.");
+		}
+		catch(Json::LogicError& e) {
+			_log->error("Animation ", _animCurrent, ":", _animStep, ": ", e.what());
+		}
+	}
+
+	if(_listener)
+		_listener->animationStep(step);
+}
+
+
+void GameFlow::endAnimation() {
+	if(_animState == ANIM_WAIT) {
+		if(_animLength >= 0 && _listener)
+			_listener->animationUpdate(_animLength);
+		nextAnimationStep();
+	}
+	else {
+		while(_animState == ANIM_PLAY) {
+			if(_animLength >= 0 && _listener)
+				_listener->animationUpdate(_animLength);
+			nextAnimationStep();
+		}
+	}
+}
@@ -0,0 +1,161 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+
+#ifndef _LD35_GAME_FLOW_H
+#define _LD35_GAME_FLOW_H
+
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+#include <lair/core/json.h>
+
+#include "ship_parts.h"
+#include "simulation.h"
+#include "map.h"
+
+
+using namespace lair;
+
+
+// The inputs that drive the game, which are recorded to (or replayed from) an
+// InputLog, one bit per input. The first ones are in SimInput order.
+enum RecordedInput {
+	REC_ACCEL,
+	REC_BRAKE,
+	REC_CLIMB,
+	REC_DIVE,
+	REC_STRETCH,
+	REC_SHRINK,
+	REC_SKIP,
+	REC_RESTART,
+	REC_COUNT
+};
+
+// Returned by GameFlow::tick() along with the SimEvents.
+enum FlowEvent {
+	FLOW_TICKED    = 1 << 8, // The simulation ticked.
+	FLOW_GAME_OVER = 1 << 9, // The last level was won.
+};
+
+
+// Shows what a GameFlow does. The flow works without one.
+class GameFlowListener {
+public:
+	virtual ~GameFlowListener() = default;
+
+	// The level was (re)started: the ship and the map are new.
+	virtual void levelStarted() = 0;
+	// An animation step begins, or the animation is over if step is null.
+	virtual void animationStep(const Json::Value* step) = 0;
+	// The animation of the current step is at time seconds.
+	virtual void animationUpdate(float time) = 0;
+};
+
+
+// The rules of a play session around the simulation: which level comes next,
+// the restart after a crash, the dialog animations that pause the game, and
+// the skip and restart inputs. It needs no window, so that recordings replay
+// the same in the game and in simulate --replay.
+class GameFlow {
+public:
+	enum AnimState {
+		ANIM_NONE,
+		ANIM_PLAY,
+		ANIM_WAIT // For the skip input.
+	};
+
+	// Length of the animated steps (show_char, hide_char, end_dialog).
+	static const float ANIM_STEP_LENGTH;
+
+public:
+	GameFlow(Map* map, Simulation* sim, float blockSize);
+
+	// maps is the content of maps.json, animations the one of
+	// animations.json.
+	void setup(const Path& dataPath, const Json::Value& maps,
+	           const Json::Value& animations, Logger& log);
+	void setListener(GameFlowListener* listener) { _listener = listener; }
+
+	// The map of a level is compiled, or without one, built from its segment
+	// images or generated; these need a Map with a loader. Return false if
+	// the level could not be loaded.
+	bool startLevel(int level);
+
+	// Play a tick with inputs, one bit per RecordedInput. Return FlowEvent
+	// and SimEvent flags.
+	unsigned tick(uint8 inputs);
+
+	int levelCount() const { return _maps.size(); }
+	int level() const { return _level; }
+	const Json::Value& levelInfo() const { return _maps[_level]; }
+	const ShipDef& shipDef() const { return _shipDef; }
+	bool isPaused() const { return _pause; }
+	AnimState animState() const { return _animState; }
+	// hashSimState() chained over the ticks since the last resetHash().
+	uint64 hash() const { return _hash; }
+	void resetHash();
+
+private:
+	bool justPressed(RecordedInput input) const;
+	bool loadMap();
+
+	void playAnimation(const std::string& name);
+	void updateAnimation(float time);
+	void nextAnimationStep();
+	void endAnimation();
+
+private:
+	Map*              _map;
+	Simulation*       _sim;
+	float             _blockSize;
+	GameFlowListener* _listener;
+	Logger*           _log;
+
+	Path        _dataPath;
+	Json::Value _maps;
+	Json::Value _animations;
+	ShipDef     _shipDef;
+
+	int         _level;
+	bool        _levelFinished;
+	bool        _pause;
+	std::vector<std::pair<int, std::string>> _mapAnims;
+	unsigned    _mapAnimIndex;
+
+	std::string _animCurrent;
+	int         _animStep;
+	AnimState   _animState;
+	float       _animPos;
+	float       _animLength; // < 0 if the step is not animated.
+
+	uint8       _inputs;
+	uint8       _prevInputs;
+	uint64      _hash;
+};
+
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+
+#include "generator.h"
+
+
+// Number of sections after which the difficulty is halfway from its start
+// value to 1.
+#define DIFFICULTY_RAMP 50.f
+
+
+Generator::Generator()
+	: _difficulty(0),
+	  _variance(0),
+	  _ahead(0),
+	  _picked(0),
+	  _produced(0),
+	  _requested(0),
+	  _taken(0),
+	  _stop(false) {
+}
+
+
+Generator::~Generator() {
+	stop();
+}
+
+
+void Generator::start(unsigned seed, const std::vector<int>& widths,
+                      float difficulty, float variance, int ahead) {
+	stop();
+
+	_widths     = widths;
+	_difficulty = std::max(0.f, std::min(difficulty, 1.f));
+	_variance   = std::max(0.f, std::min(variance, 1.f));
+	_ahead      = ahead;
+	_rand.seed(seed);
+	_picked     = 0;
+
+	_queue.clear();
+	_produced   = 0;
+	_requested  = 0;
+	_taken      = 0;
+	_stop       = false;
+
+	if(!_widths.empty())
+		_thread = std::thread(&Generator::run, this);
+}
+
+
+void Generator::stop() {
+	if(!_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cond.notify_all();
+	_thread.join();
+}
+
+
+void Generator::take(int length, std::vector<unsigned>& indices) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	if(length > _requested) {
+		_requested = length;
+		_cond.notify_all();
+	}
+
+	while(_taken < length && !_stop) {
+		if(_queue.empty()) {
+			_cond.wait(lock);
+			continue;
+		}
+		unsigned i = _queue.front();
+		_queue.pop_front();
+		_taken += _widths[i];
+		indices.push_back(i);
+	}
+}
+
+
+void Generator::run() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while(!_stop) {
+		if(_produced >= _requested + _ahead) {
+			_cond.wait(lock);
+			continue;
+		}
+
+		// Only this thread touches the random engine.
+		lock.unlock();
+		unsigned i = pick();
+		lock.lock();
+
+		_queue.push_back(i);
+		_produced += _widths[i];
+		_cond.notify_all();
+	}
+}
+
+
+unsigned Generator::pick() {
+	// Plain float arithmetic and the raw engine output (whose sequence is
+	// specified by the standard, unlike std::uniform_int_distribution) keep
+	// the picks identical across platforms.
+	float difficulty = 1 - (1 - _difficulty) * DIFFICULTY_RAMP
+	                                         / (DIFFICULTY_RAMP + _picked);
+	++_picked;
+
+	unsigned size   = _widths.size();
+	unsigned range  = std::max(1u, std::min(size, unsigned(size * _variance)));
+	int      center = difficulty * (size - 1);
+	int      begin  = std::max(0, std::min(center - int(range / 2), int(size - range)));
+
+	return begin + _rand() % range;
+}
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _LD35_GENERATOR_H
+#define _LD35_GENERATOR_H
+
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+// Picks sections at random from a pool sorted by increasing difficulty,
+// following a difficulty curve that starts at difficulty and tends to 1.
+// Picking runs on a worker thread that stays ahead columns ahead of what has
+// been requested with take(). The picked sequence only depends on the
+// parameters passed to start(), not on timing.
+class Generator {
+public:
+	Generator();
+	Generator(const Generator&)  = delete;
+	Generator(      Generator&&) = delete;
+	~Generator();
+
+	Generator& operator=(const Generator&)  = delete;
+	Generator& operator=(      Generator&&) = delete;
+
+	// widths are the widths (in columns) of the sections of the pool.
+	void start(unsigned seed, const std::vector<int>& widths,
+	           float difficulty, float variance, int ahead);
+	void stop();
+	bool isRunning() const { return _thread.joinable(); }
+
+	// Append to indices the next sections picked, until at least length
+	// columns have been taken since start(). Blocks only if the worker is
+	// behind.
+	void take(int length, std::vector<unsigned>& indices);
+
+private:
+	void run();
+	unsigned pick();
+
+private:
+	std::vector<int>        _widths;
+	float                   _difficulty;
+	float                   _variance;
+	int                     _ahead;
+	std::mt19937            _rand;
+	unsigned                _picked;
+
+	std::thread             _thread;
+	std::mutex              _mutex;
+	std::condition_variable _cond;
+	std::deque<unsigned>    _queue;
+	int                     _produced;
+	int                     _requested;
+	int                     _taken;
+	bool                    _stop;
+};
+
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <vector>
+
+#include <lair/core/log.h>
+
+#include "gl_program.h"
+
+
+static GLuint compileShader(Context* glc, GLenum type, const char* source) {
+	GLuint shader = glc->createShader(type);
+	glc->shaderSource(shader, 1, &source, nullptr);
+	glc->compileShader(shader);
+
+	GLint status = 0;
+	glc->getShaderiv(shader, gl::COMPILE_STATUS, &status);
+	if(!status) {
+		GLint length = 0;
+		glc->getShaderiv(shader, gl::INFO_LOG_LENGTH, &length);
+		std::vector<GLchar> log(length + 1, 0);
+		glc->getShaderInfoLog(shader, length, nullptr, log.data());
+		dbgLogger.error("Failed to compile shader: ", log.data());
+		glc->deleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+
+GLuint createProgram(Context* glc, const char* vertSource, const char* fragSource,
+                     const AttribBinding* attribs, unsigned attribCount) {
+	GLuint vert = compileShader(glc, gl::VERTEX_SHADER,   vertSource);
+	GLuint frag = compileShader(glc, gl::FRAGMENT_SHADER, fragSource);
+	if(!vert || !frag) {
+		glc->deleteShader(vert);
+		glc->deleteShader(frag);
+		return 0;
+	}
+
+	GLuint program = glc->createProgram();
+	glc->attachShader(program, vert);
+	glc->attachShader(program, frag);
+	for(unsigned i = 0; i < attribCount; ++i) {
+		glc->bindAttribLocation(program, attribs[i].location, attribs[i].name);
+	}
+	glc->linkProgram(program);
+
+	// The program keeps the shaders alive as long as it needs them.
+	glc->deleteShader(vert);
+	glc->deleteShader(frag);
+
+	GLint status = 0;
+	glc->getProgramiv(program, gl::LINK_STATUS, &status);
+	if(!status) {
+		GLint length = 0;
+		glc->getProgramiv(program, gl::INFO_LOG_LENGTH, &length);
+		std::vector<GLchar> log(length + 1, 0);
+		glc->getProgramInfoLog(program, length, nullptr, log.data());
+		dbgLogger.error("Failed to link shader program: ", log.data());
+		glc->deleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
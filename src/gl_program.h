@@ -0,0 +1,47 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_GL_PROGRAM_H
+#define _LD35_GL_PROGRAM_H
+
+
+#include <lair/core/lair.h>
+
+#include <lair/render_gl2/context.h>
+
+
+using namespace lair;
+
+
+// An attribute of a program and the location it is bound to.
+struct AttribBinding {
+	GLuint      location;
+	const char* name;
+};
+
+// Compile and link a shader program drawn outside of the SpriteRenderer.
+// Returns 0 and logs the error on failure.
+GLuint createProgram(Context* glc, const char* vertSource, const char* fragSource,
+                     const AttribBinding* attribs, unsigned attribCount);
+
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <cstdio>
+
+#include "hud_text.h"
+
+
+#define BUFSIZE 128
+
+
+HudText::HudText()
+	: _texts(nullptr),
+	  _valid(false),
+	  _value(0) {
+}
+
+
+void HudText::setEntity(BitmapTextComponentManager* texts, EntityRef entity) {
+	_texts  = texts;
+	_entity = entity;
+	invalidate();
+}
+
+
+bool HudText::update(double value, const char* format) {
+	if(_valid && value == _value)
+		return false;
+	_value = value;
+
+	// Different values often print the same (e.g. the distance between two
+	// frames): compare the strings before laying out the glyphs.
+	char buff[BUFSIZE];
+	snprintf(buff, BUFSIZE, format, value);
+	if(_valid && _text == buff)
+		return false;
+
+	_valid = true;
+	_text  = buff;
+	_texts->get(_entity)->setText(_text);
+	return true;
+}
+
+
+void HudText::invalidate() {
+	_valid = false;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_HUD_TEXT_H
+#define _LD35_HUD_TEXT_H
+
+
+#include <string>
+
+#include <lair/core/lair.h>
+
+#include <lair/ec/entity.h>
+#include <lair/ec/bitmap_text_component.h>
+
+
+using namespace lair;
+
+
+// A text of the HUD that is only formatted and laid out again when the value
+// it shows changes.
+class HudText {
+public:
+	HudText();
+
+	void setEntity(BitmapTextComponentManager* texts, EntityRef entity);
+
+	// Show value, with a printf format that takes a single double. Return
+	// true if the text was rebuilt.
+	bool update(double value, const char* format);
+	// Rebuild the text at the next update().
+	void invalidate();
+
+private:
+	BitmapTextComponentManager* _texts;
+	EntityRef                   _entity;
+	bool                        _valid;
+	double                      _value;
+	std::string                 _text;
+};
+
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "simulation.h"
+
+#include "input_log.h"
+
+
+InputLog::InputLog()
+    : _tick(0),
+      _eventTick(0),
+      _inputs(0),
+      _readPos(0),
+      _nextInput(-1) {
+	startRecording(0, 0);
+}
+
+
+void InputLog::startRecording(unsigned tickRate, unsigned level) {
+	std::memset(&_header, 0, sizeof(_header));
+	std::strncpy(_header.magic, INPUT_LOG_MAGIC, sizeof(_header.magic));
+	_header.version  = INPUT_LOG_VERSION;
+	_header.tickRate = tickRate;
+	_header.level    = level;
+#ifdef SHAPEOUT_DETERMINISTIC
+	_header.deterministic = 1;
+#endif
+
+	_events.clear();
+	_tick      = 0;
+	_eventTick = 0;
+	_inputs    = 0;
+}
+
+
+void InputLog::record(uint8 inputs) {
+	uint8 changed = inputs ^ _inputs;
+	for(unsigned input = 0; changed; ++input, changed >>= 1) {
+		if(changed & 1)
+			pushEvent(input);
+	}
+	_inputs = inputs;
+
+	++_tick;
+	_header.tickCount = _tick;
+}
+
+
+void InputLog::setEnd(unsigned level, float score, float distance, uint64 hash) {
+	_header.endLevel    = level;
+	_header.endScore    = score;
+	_header.endDistance = distance;
+	_header.endHash     = hash;
+}
+
+
+bool InputLog::save(const Path& path, Logger& log) const {
+	std::ofstream out(path.utf8CStr(), std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+	out.write(reinterpret_cast<const char*>(_events.data()), _events.size());
+	if(!out) {
+		log.error("Failed to write input log \"", path, "\".");
+		return false;
+	}
+	return true;
+}
+
+
+bool InputLog::load(const Path& path, Logger& log) {
+	std::ifstream in(path.utf8CStr(), std::ios::binary);
+	in.read(reinterpret_cast<char*>(&_header), sizeof(_header));
+	if(!in
+	|| std::strncmp(_header.magic, INPUT_LOG_MAGIC, sizeof(_header.magic)) != 0
+	|| _header.version != INPUT_LOG_VERSION) {
+		log.error("Invalid input log \"", path, "\".");
+		startRecording(0, 0);
+		return false;
+	}
+	if(_header.tickRate < MIN_TICK_RATE || _header.tickRate > MAX_TICK_RATE) {
+		log.error("Input log \"", path, "\" has an invalid tick rate: ",
+		          _header.tickRate, ".");
+		startRecording(0, 0);
+		return false;
+	}
+
+	_events.assign(std::istreambuf_iterator<char>(in),
+	               std::istreambuf_iterator<char>());
+	startReplay();
+	return true;
+}
+
+
+void InputLog::startReplay() {
+	_tick      = 0;
+	_eventTick = 0;
+	_inputs    = 0;
+	_readPos   = 0;
+	readEvent();
+}
+
+
+bool InputLog::replay(uint8* inputs) {
+	if(isReplayDone())
+		return false;
+
+	while(_nextInput >= 0 && _eventTick == _tick) {
+		_inputs ^= 1 << _nextInput;
+		readEvent();
+	}
+	*inputs = _inputs;
+
+	++_tick;
+	return true;
+}
+
+
+void InputLog::pushEvent(unsigned input) {
+	lairAssert(input < MAX_INPUTS);
+
+	uint64 value = (uint64(_tick - _eventTick) << 3) | input;
+	do {
+		_events.push_back((value & 0x7f) | (value > 0x7f? 0x80: 0));
+		value >>= 7;
+	} while(value);
+	_eventTick = _tick;
+}
+
+
+// Read the event at _readPos. Set _nextInput to -1 at the end of the log, or
+// if it is truncated.
+bool InputLog::readEvent() {
+	uint64   value = 0;
+	unsigned shift = 0;
+	while(_readPos < _events.size() && shift < 64) {
+		uint8 byte = _events[_readPos++];
+		value |= uint64(byte & 0x7f) << shift;
+		shift += 7;
+		if(!(byte & 0x80)) {
+			_eventTick += value >> 3;
+			_nextInput  = value & 0x7;
+			return true;
+		}
+	}
+	_nextInput = -1;
+	return false;
+}
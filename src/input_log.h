@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _LD35_INPUT_LOG_H
+#define _LD35_INPUT_LOG_H
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+
+
+using namespace lair;
+
+
+#define INPUT_LOG_MAGIC   "LD35REC"
+#define INPUT_LOG_VERSION 2
+
+// Input log files are a header followed by the events. An event is an input
+// that changed state, stored as a varint of (ticks since the previous event
+// << 3 | input). Holding a key costs nothing, a change one byte if it comes
+// less than 16 ticks after the previous one and two otherwise: an hour of
+// play at 4 changes per second is about 19 kB.
+struct InputLogHeader {
+	char   magic[8];
+	uint32 version;
+	uint32 tickRate;
+	uint32 level;      // Level at the first tick.
+	uint32 tickCount;
+	uint32 endLevel;   // State after the last tick, to check replays.
+	float  endScore;
+	float  endDistance;
+	uint32 deterministic; // 1 if recorded by a SHAPEOUT_DETERMINISTIC build.
+	uint64 endHash;       // hashSimState() chained over the ticks.
+};
+
+
+// The state of up to 8 inputs at every tick, one bit per input, recorded
+// from a play session or replayed in place of the real inputs.
+class InputLog {
+public:
+	enum {
+		MAX_INPUTS = 8,
+	};
+
+public:
+	InputLog();
+
+	void startRecording(unsigned tickRate, unsigned level);
+	void record(uint8 inputs);
+	void setEnd(unsigned level, float score, float distance, uint64 hash);
+	bool save(const Path& path, Logger& log) const;
+
+	// Fail on files of another version or with a tick rate out of
+	// [MIN_TICK_RATE, MAX_TICK_RATE].
+	bool load(const Path& path, Logger& log);
+	void startReplay();
+	// Set inputs to the state of the next tick, or return false if all the
+	// ticks have been replayed.
+	bool replay(uint8* inputs);
+	bool isReplayDone() const { return _tick == _header.tickCount; }
+
+	unsigned tickRate()  const { return _header.tickRate; }
+	unsigned level()     const { return _header.level; }
+	unsigned tickCount() const { return _header.tickCount; }
+	const InputLogHeader& header() const { return _header; }
+	size_t byteSize() const { return sizeof(InputLogHeader) + _events.size(); }
+
+private:
+	void pushEvent(unsigned input);
+	bool readEvent();
+
+private:
+	InputLogHeader     _header;
+	std::vector<uint8> _events;
+
+	unsigned _tick;
+	unsigned _eventTick;   // Tick of the last event written or read.
+	uint8    _inputs;
+	size_t   _readPos;
+	int      _nextInput;   // Input of the event at _eventTick, -1 if none.
+};
+
+
+#endif
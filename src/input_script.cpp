@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "input_script.h"
+
+
+InputScript::InputScript() {
+}
+
+
+bool InputScript::load(const Path& path, Logger& log) {
+	static const char* names[] = { "accel", "brake", "climb", "dive",
+	                               "stretch", "shrink" };
+
+	clear();
+	std::ifstream in(path.utf8CStr());
+	if(!in) {
+		log.error("Failed to open \"", path, "\".");
+		return false;
+	}
+
+	std::string line;
+	for(unsigned lineNo = 1; std::getline(in, line); ++lineNo) {
+		std::istringstream words(line);
+		Line sl = { 0, 0 };
+		if(line.empty() || line[0] == '#' || !(words >> sl.tick))
+			continue;
+
+		std::string word;
+		while(words >> word) {
+			unsigned b = 0;
+			while(b < 6 && word != names[b]) ++b;
+			if(b == 6) {
+				log.error(path, ":", lineNo, ": unknown button \"", word, "\".");
+				return false;
+			}
+			sl.buttons |= 1 << b;
+		}
+		if(!_lines.empty() && sl.tick < _lines.back().tick) {
+			log.error(path, ":", lineNo, ": ticks must be increasing.");
+			return false;
+		}
+		_lines.push_back(sl);
+	}
+	return true;
+}
+
+
+void InputScript::clear() {
+	_lines.clear();
+}
+
+
+void InputScript::addLine(unsigned tick, uint8 buttons) {
+	lairAssert(_lines.empty() || tick >= _lines.back().tick);
+	Line line = { tick, buttons };
+	_lines.push_back(line);
+}
+
+
+uint8 InputScript::buttons(unsigned tick) const {
+	auto it = std::upper_bound(_lines.begin(), _lines.end(), tick,
+	                           [](unsigned t, const Line& line) { return t < line.tick; });
+	return it == _lines.begin()? 0: (it - 1)->buttons;
+}
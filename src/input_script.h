@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_INPUT_SCRIPT_H
+#define _LD35_INPUT_SCRIPT_H
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+
+
+using namespace lair;
+
+
+// The buttons held during a run of a level, written by hand: lines of
+// "<tick> <button>...", the buttons (accel, brake, climb, dive, stretch,
+// shrink) being held from that tick of the level on, until the next line.
+// Lines starting with # are ignored.
+class InputScript {
+public:
+	struct Line {
+		unsigned tick;
+		uint8    buttons; // SimInput::Button flags.
+	};
+
+public:
+	InputScript();
+
+	bool load(const Path& path, Logger& log);
+	void clear();
+	void addLine(unsigned tick, uint8 buttons);
+
+	bool empty() const { return _lines.empty(); }
+	// The buttons held at tick, none before the first line.
+	uint8 buttons(unsigned tick) const;
+
+private:
+	std::vector<Line> _lines;
+};
+
+
+#endif
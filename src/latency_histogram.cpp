@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "latency_histogram.h"
+
+
+inline unsigned lastBit(uint64 value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+
+LatencyHistogram::LatencyHistogram()
+    : _buckets(BUCKET_COUNT, 0) {
+	reset();
+}
+
+
+void LatencyHistogram::reset() {
+	std::fill(_buckets.begin(), _buckets.end(), 0);
+	_count = 0;
+	_max   = 0;
+	_total = 0;
+}
+
+
+void LatencyHistogram::record(int64 ns) {
+	ns = std::max<int64>(ns, 0);
+	++_buckets[bucketIndex(ns)];
+	++_count;
+	_max    = std::max(_max, ns);
+	_total += ns;
+}
+
+
+double LatencyHistogram::mean() const {
+	return _count? _total / _count: 0;
+}
+
+
+int64 LatencyHistogram::percentile(double p) const {
+	if(!_count)
+		return 0;
+
+	uint64 rank = std::max<uint64>(std::ceil(_count * std::min(p, 100.) / 100.), 1);
+	uint64 seen = 0;
+	for(unsigned i = 0; i < BUCKET_COUNT; ++i) {
+		seen += _buckets[i];
+		if(seen >= rank)
+			return std::min<uint64>(bucketEnd(i), _max);
+	}
+	return _max;
+}
+
+
+// Values below 2 * SUB_BUCKETS have a bucket each. Above, the bucket is given
+// by the position of the highest bit and the SUB_BUCKET_BITS bits after it.
+unsigned LatencyHistogram::bucketIndex(uint64 value) {
+	if(value < 2 * SUB_BUCKETS)
+		return value;
+	unsigned shift = lastBit(value) - SUB_BUCKET_BITS;
+	return (shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS;
+}
+
+
+// The last value of the bucket index.
+uint64 LatencyHistogram::bucketEnd(unsigned index) {
+	if(index < 2 * SUB_BUCKETS)
+		return index;
+	unsigned shift = index / SUB_BUCKETS - 1;
+	uint64   first = uint64(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+	return first + ((uint64(1) << shift) - 1);
+}
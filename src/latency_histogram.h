@@ -0,0 +1,74 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_LATENCY_HISTOGRAM_H
+#define _LD35_LATENCY_HISTOGRAM_H
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+// A histogram of durations in nanoseconds, in the style of HdrHistogram:
+// each power of two is split in SUB_BUCKETS buckets, so any percentile is
+// known within 1/SUB_BUCKETS (about 3%) of its value, from nanoseconds to
+// centuries, in constant memory. record() is a few instructions, cheap
+// enough to be called every frame.
+class LatencyHistogram {
+public:
+	enum {
+		SUB_BUCKET_BITS = 5,
+		SUB_BUCKETS     = 1 << SUB_BUCKET_BITS,
+		BUCKET_COUNT    = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS,
+	};
+
+public:
+	LatencyHistogram();
+
+	void reset();
+	// Negative durations count as 0.
+	void record(int64 ns);
+
+	uint64 count() const { return _count; }
+	int64  max()   const { return _max; }
+	double mean()  const;
+	// The duration that p percent of the recorded ones do not exceed, rounded
+	// up to the end of its bucket. 0 if the histogram is empty.
+	int64  percentile(double p) const;
+
+private:
+	static unsigned bucketIndex(uint64 value);
+	static uint64   bucketEnd(unsigned index);
+
+private:
+	std::vector<uint64> _buckets;
+	uint64              _count;
+	int64               _max;
+	double              _total;
+};
+
+
+#endif
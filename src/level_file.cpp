@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include "level_file.h"
+
+
+namespace {
+
+uint32 hashBytes(const void* data, size_t size, uint32 hash) {
+	// FNV-1a
+	const uint8* bytes = static_cast<const uint8*>(data);
+	for(size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+}
+
+
+Path buildDataPath(const Path& dataDir) {
+#ifdef SHAPEOUT_BUILD_DATA_DIR
+	(void)dataDir;
+	return Path(SHAPEOUT_BUILD_DATA_DIR);
+#else
+	return dataDir;
+#endif
+}
+
+
+std::string levelFilePath(unsigned level) {
+	return "levels/level_" + std::to_string(level) + ".bin";
+}
+
+
+uint32 hashSegments(const Json::Value& segments, const Path& dataDir) {
+	uint32 hash = 2166136261u;
+	for(unsigned i = 0; i < segments.size(); ++i) {
+		std::string segment = segments[i].asString();
+		if(segment.empty())
+			continue;
+		hash = hashBytes(segment.c_str(), segment.size() + 1, hash);
+
+		// Seconds are enough: levelc runs after the images are saved.
+		struct stat info;
+		int64 stamp[2] = { 0, 0 };
+		if(stat((dataDir / Path(segment)).utf8CStr(), &info) == 0) {
+			stamp[0] = info.st_size;
+			stamp[1] = info.st_mtime;
+		}
+		hash = hashBytes(stamp, sizeof(stamp), hash);
+	}
+	return hash;
+}
+
+
+const LevelFileHeader* checkLevelFile(const uint8* data, size_t size, unsigned nRows,
+                                      uint32 segmentsHash, const Path& path) {
+	const LevelFileHeader* header = reinterpret_cast<const LevelFileHeader*>(data);
+	size_t expected = sizeof(LevelFileHeader);
+	if(size >= expected)
+		expected += 2 * sizeof(uint32) * size_t(header->length);
+
+	if(size < sizeof(LevelFileHeader)
+	|| std::strncmp(header->magic, LEVEL_FILE_MAGIC, sizeof(header->magic)) != 0
+	|| header->version != LEVEL_FILE_VERSION
+	|| header->nRows != nRows
+	|| size != expected) {
+		dbgLogger.warning("Invalid compiled level \"", path, "\".");
+		return nullptr;
+	}
+	if(header->segmentsHash != segmentsHash) {
+		dbgLogger.warning("Compiled level \"", path, "\" is out of date.");
+		return nullptr;
+	}
+	return header;
+}
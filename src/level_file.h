@@ -0,0 +1,78 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _LD35_LEVEL_FILE_H
+#define _LD35_LEVEL_FILE_H
+
+
+#include <string>
+
+#include <lair/core/lair.h>
+#include <lair/core/json.h>
+#include <lair/core/log.h>
+
+
+using namespace lair;
+
+
+#define LEVEL_FILE_MAGIC   "LD35LVL"
+#define LEVEL_FILE_VERSION 2
+
+// Compiled level files are a header followed by the wall masks of every
+// column, then the point masks of every column, one bit per row. They
+// are built from maps.json by the levelc tool and memory-mapped by the game.
+struct LevelFileHeader {
+	char   magic[8];
+	uint32 version;
+	uint32 nRows;
+	uint32 length;
+	uint32 segmentsHash;
+};
+
+
+// Directory of the data the build generates (the compiled levels and the
+// texture atlas): the SHAPEOUT_BUILD_DATA_DIR of the build, or dataDir if it
+// was built without one.
+Path buildDataPath(const Path& dataDir);
+
+// Path of the compiled file of a level, relative to buildDataPath().
+std::string levelFilePath(unsigned level);
+
+// Hash of a level segment list and of the size and modification time of the
+// segment images in dataDir, used to detect stale compiled files: a level is
+// out of date as soon as one of its images is edited.
+uint32 hashSegments(const Json::Value& segments, const Path& dataDir);
+
+// The header of the compiled level in data, or null (with a warning) if it is
+// not a level of nRows rows or is out of date with segmentsHash. path is only
+// used in the warnings.
+const LevelFileHeader* checkLevelFile(const uint8* data, size_t size, unsigned nRows,
+                                      uint32 segmentsHash, const Path& path);
+
+inline const uint32* levelWalls(const LevelFileHeader* header) {
+	return reinterpret_cast<const uint32*>(header + 1);
+}
+inline const uint32* levelPoints(const LevelFileHeader* header) {
+	return levelWalls(header) + header->length;
+}
+
+
+#endif
@@ -19,26 +19,23 @@
  */
 
 
+#include <cmath>
+#include <cstdio>
 #include <functional>
 
 #include <lair/core/json.h>
 
 #include "game.h"
 #include "splash_state.h"
+#include "level_file.h"
 
 #include "main_state.h"
 
 
-#define ONE_SEC (1000000000)
-
-//FIXME?
-#define SCREEN_WIDTH  1920
-#define SCREEN_HEIGHT 1080
-
-#define BUFSIZE 128
-
 #define FRAMERATE 60
 
+#define PROFILE_FILE "profile.json"
+
 
 Vector4 parseColor(const Json::Value& color) {
 	lairAssert(color.isArray() && color.size() == 4);
@@ -74,9 +71,11 @@ MainState::MainState(Game* game)
       _initialized(false),
       _running(false),
       _loop(sys()),
-      _fpsTime(0),
-      _fpsCount(0),
-      _prevFrameTime(0),
+      _showStats(false),
+      _statsTime(0),
+      _statsFrameCount(0),
+      _textRebuilds(0),
+      _tickRate(0),
 
       _quitInput    (nullptr),
       _restartInput (nullptr),
@@ -86,56 +85,21 @@ MainState::MainState(Game* game)
       _diveInput    (nullptr),
       _stretchInput (nullptr),
       _shrinkInput  (nullptr),
+      _skipInput    (nullptr),
+      _tilesInput   (nullptr),
+      _profileInput (nullptr),
+      _statsInput   (nullptr),
 
-      _map(this),
-
-      _currentLevel (-1),
+      _replaying     (false),
+      _tickInputs    (0),
 
-      _shipPartCount(6),
       _blockSize    (48),
+      _map(loader(), _blockSize),
+      _mapRenderer(this, &_map),
+      _sim(&_map, _blockSize),
+      _flow(&_map, &_sim, _blockSize),
 
-      _hSpeedDamping(500),
-      _acceleration (400),
-      _minShipHSpeed(1000),
-      _brakingFactor(0.99),
-
-/* One full-charge tap up or down will instantly reach 1/8 of a block.
- * - This is about enough for a "human" tap at 60FPS to move one block away.
- * Tap power is restored over half a second.
- * Thrust is the base climb/dive power ; worth one tap every 1/6th second.
- */
-      _thrustMaxCharge  (_blockSize / 8),
-      _thrustRateCharge (2 * _thrustMaxCharge / FRAMERATE),
-      _thrustPower      (_thrustMaxCharge / 10),
-
-/* Damping is a factor (about .5~.9) to let vertical speed decrease over time.
- * - Below .5, one tap does not reach one block ; above .8 it may jump two.
- * Below min speed (0.2 block/s), the ship halts and snaps to grid.
- * The ship should never go above max speed (0.5 block/f) for safety reasons.
- * When left adrift, the ship will line in, covering 10% of the gap each frame.
- */
-      _vSpeedDamping (0.8),
-      _vSpeedFloor   (0.2 * _blockSize / FRAMERATE),
-      _vSpeedCap     (_blockSize / 2),
-      _vLockFactor   (0.1),
-
-/* Collisions above scratch threshold will bump the player.
- * Collisions above crash threshold will kill the player.
- * When bumping against a wall, the player will be ejected within two frames.
- */
-      _scratchThreshold (_blockSize / 4),
-      _crashThreshold   (_blockSize / 2),
-      _bumpawayTime     (2),
-
-/* Parts move at a top rate of 1/4 block per frame.
- * Destroyed parts are bumped up then fall offscreen at 1/5 block per frame.
- * Parts are lost when going further away (by 1 block) than the farthest part.
- * The mass ratio reduces the drag feedback from the parts.
- */
-      _partBaseSpeed (_blockSize / 4),
-      _partDropSpeed (_blockSize / 3),
-      _snapDistance  (_blockSize * (6+1)),
-      _massRatio     (1.0/16)
+      _shipPartCount(0)
 {
 	_entities.registerComponentManager(&_sprites);
 	_entities.registerComponentManager(&_texts);
@@ -150,14 +114,37 @@ void MainState::initialize() {
 	// Set to true to debug OpenGL calls
 	renderer()->context()->setLogCalls(false);
 
+	Json::Value config;
+	parseJson(config, _game->dataPath() / "config.json", "config.json", log());
+
+	unsigned tickRate = game()->tickRate();
+	if(!tickRate)
+		tickRate = config.get("tick_rate", 60).asUInt();
+	if(tickRate < MIN_TICK_RATE || tickRate > MAX_TICK_RATE) {
+		log().warning("Invalid tick rate ", tickRate, ", using 60");
+		tickRate = 60;
+	}
+
+	// Replays run at the rate they were recorded at.
+	const Path& replayPath = game()->replayPath();
+	if(!replayPath.empty() && _inputLog.load(replayPath, log())) {
+		log().info("Replaying \"", replayPath, "\": ", _inputLog.tickCount(), " ticks");
+		_replaying = true;
+		tickRate = _inputLog.tickRate();
+	}
+	log().info("Tick rate: ", tickRate);
+
 	_loop.reset();
-	_loop.setTickDuration(  ONE_SEC / 60);
+	setTickRate(tickRate);
 	_loop.setFrameDuration( ONE_SEC / 60);
 	_loop.setMaxFrameDuration(_loop.frameDuration() * 3);
+	_frameStats.setMaxFrameDuration(_loop.frameDuration() * 3);
 	_loop.setFrameMargin(     _loop.frameDuration() / 2);
 
 	window()->onResize.connect(std::bind(&MainState::resizeEvent, this))
 	        .track(_slotTracker);
+	_sim.setScreenWidth(float(window()->width() * SCREEN_HEIGHT)
+	                    / window()->height());
 
 	_quitInput    = _inputs.addInput("quit");
 	_restartInput = _inputs.addInput("restart");
@@ -168,6 +155,9 @@ void MainState::initialize() {
 	_stretchInput = _inputs.addInput("stretch");
 	_shrinkInput  = _inputs.addInput("shrink");
 	_skipInput    = _inputs.addInput("skip");;
+	_tilesInput   = _inputs.addInput("tiles");
+	_profileInput = _inputs.addInput("profile");
+	_statsInput   = _inputs.addInput("stats");
 
 	_inputs.mapScanCode(_quitInput,    SDL_SCANCODE_ESCAPE);
 	_inputs.mapScanCode(_restartInput, SDL_SCANCODE_F5);
@@ -178,72 +168,44 @@ void MainState::initialize() {
 	_inputs.mapScanCode(_stretchInput, SDL_SCANCODE_X);
 	_inputs.mapScanCode(_shrinkInput,  SDL_SCANCODE_Z);
 	_inputs.mapScanCode(_skipInput,    SDL_SCANCODE_SPACE);
+	_inputs.mapScanCode(_tilesInput,   SDL_SCANCODE_F2);
+	_inputs.mapScanCode(_profileInput, SDL_SCANCODE_F3);
+	_inputs.mapScanCode(_statsInput,   SDL_SCANCODE_F4);
 
-	parseJson(_animations, _game->dataPath() / "animations.json",
-	          "animations.json", log());
-
-	_beamsTex = loader()->loadAsset<ImageLoader>("beams.png");
-	renderer()->createTexture(_beamsTex);
+	_atlas.load(loader(), renderer(), buildDataPath(_game->dataPath()), "atlas/atlas.json", log());
+	_beamsTex = _atlas.texture("beams.png", _beamsTexCoord);
 
 	_warningSound = loader()->loadAsset<SoundLoader>("warning.wav");
 	_pointSound   = loader()->loadAsset<SoundLoader>("ping.wav");
 	_crashSound   = loader()->loadAsset<SoundLoader>("crash.wav");
 
 	_map.initialize();
-	_map.setBgScroll(0, .4);
-	_map.setBgScroll(1, .7);
+	_mapRenderer.initialize();
+	_mapRenderer.setBgScroll(0, .4);
+	_mapRenderer.setBgScroll(1, .7);
 
-	parseJson(_mapInfo, _game->dataPath() / "maps.json",
-	          "maps.json", log());
+	std::string tileRenderer = config.get("tile_renderer", "mesh").asString();
+	for(int tr = 0; tr < MapRenderer::TILE_RENDERER_COUNT; ++tr) {
+		if(tileRenderer == MapRenderer::tileRendererName(MapRenderer::TileRenderer(tr)))
+			_mapRenderer.setTileRenderer(MapRenderer::TileRenderer(tr));
+	}
 
-	_shipShapes.push_back(Vector2(0,  1));
-	_shipShapes.push_back(Vector2(1,  1));
-	_shipShapes.push_back(Vector2(2,  1));
-	_shipShapes.push_back(Vector2(0, -1));
-	_shipShapes.push_back(Vector2(1, -1));
-	_shipShapes.push_back(Vector2(2, -1));
-
-	_shipShapes.push_back(Vector2(0,  2));
-	_shipShapes.push_back(Vector2(0,  1));
-	_shipShapes.push_back(Vector2(1,  1));
-	_shipShapes.push_back(Vector2(0, -2));
-	_shipShapes.push_back(Vector2(0, -1));
-	_shipShapes.push_back(Vector2(1, -1));
-
-	_shipShapes.push_back(Vector2(-1,  2));
-	_shipShapes.push_back(Vector2( 0,  2));
-	_shipShapes.push_back(Vector2( 1,  2));
-	_shipShapes.push_back(Vector2(-1, -2));
-	_shipShapes.push_back(Vector2( 0, -2));
-	_shipShapes.push_back(Vector2( 1, -2));
-
-	_shipShapes.push_back(Vector2(-1,  3));
-	_shipShapes.push_back(Vector2( 0,  3));
-	_shipShapes.push_back(Vector2( 1,  2));
-	_shipShapes.push_back(Vector2(-1, -3));
-	_shipShapes.push_back(Vector2( 0, -3));
-	_shipShapes.push_back(Vector2( 1, -2));
-
-	_shipShapes.push_back(Vector2(-2,  4));
-	_shipShapes.push_back(Vector2(-1,  4));
-	_shipShapes.push_back(Vector2( 1,  2));
-	_shipShapes.push_back(Vector2(-2, -4));
-	_shipShapes.push_back(Vector2(-1, -4));
-	_shipShapes.push_back(Vector2( 1, -2));
-
-	_shipShapes.push_back(Vector2(-2,  5));
-	_shipShapes.push_back(Vector2(-1,  4));
-	_shipShapes.push_back(Vector2( 1,  2));
-	_shipShapes.push_back(Vector2(-2, -5));
-	_shipShapes.push_back(Vector2(-1, -4));
-	_shipShapes.push_back(Vector2( 1, -2));
-
-	_shipShapes.push_back(Vector2(-3,  6));
-	_shipShapes.push_back(Vector2(-1,  4));
-	_shipShapes.push_back(Vector2( 1,  2));
-	_shipShapes.push_back(Vector2(-3, -6));
-	_shipShapes.push_back(Vector2(-1, -4));
-	_shipShapes.push_back(Vector2( 1, -2));
+	Json::Value maps;
+	parseJson(maps, _game->dataPath() / "maps.json",
+	          "maps.json", log());
+	if(game()->endless()) {
+		Json::Value endless;
+		if(parseJson(endless, _game->dataPath() / "endless.json", "endless.json", log())) {
+			endless["generate"]["seed"] = game()->endlessSeed();
+			maps = Json::Value(Json::arrayValue);
+			maps.append(endless);
+		}
+	}
+	Json::Value animations;
+	parseJson(animations, _game->dataPath() / "animations.json",
+	          "animations.json", log());
+	_flow.setup(_game->dataPath(), maps, animations, log());
+	_flow.setListener(this);
 
 	_gameLayer = _entities.createEntity(_entities.root(), "game_layer");
 	_hudLayer  = _entities.createEntity(_entities.root(), "hud_layer");
@@ -319,11 +281,23 @@ void MainState::initialize() {
 	_distanceText.place(Vector3(230, -tvOff, 0));
 	_texts.get(_distanceText)->setAnchor(Vector2(1, 0));
 
+	_scoreHud   .setEntity(&_texts, _scoreText);
+	_speedHud   .setEntity(&_texts, _speedText);
+	_distanceHud.setEntity(&_texts, _distanceText);
+
+	_statsText = loadEntity("text.json", _hudLayer);
+	_statsText.place(Vector3(16, 1000, 0));
+	_texts.get(_statsText)->setAnchor(Vector2(0, 1));
+	_texts.get(_statsText)->setText("");
+
 	_shipSound = loader()->loadAsset<SoundLoader>("engine0.wav");
 	//loader()->load<MusicLoader>("music.ogg");
 
-	loader()->waitAll();
-	renderer()->uploadPendingTextures();
+	{
+		PROFILE_ZONE("Load assets");
+		loader()->waitAll();
+		renderer()->uploadPendingTextures();
+	}
 
 	Mix_Volume(-1, 64);
 
@@ -332,8 +306,21 @@ void MainState::initialize() {
 }
 
 
+// Tick rates are such that ticks last a whole number of nanoseconds, up to
+// rounding: 60, 120 and 240 are the intended ones.
+void MainState::setTickRate(unsigned rate) {
+	_tickRate = rate;
+	_loop.setTickDuration(ONE_SEC / rate);
+	_sim.setTickDuration(_loop.tickDuration());
+}
+
+
 void MainState::shutdown() {
+	if(Profiler::isEnabled())
+		Profiler::writeChromeTrace(PROFILE_FILE, log());
+
 	_slotTracker.disconnectAll();
+	_mapRenderer.shutdown();
 
 	_initialized = false;
 }
@@ -345,22 +332,46 @@ void MainState::run() {
 	log().log("Starting main state...");
 	_running = true;
 	_loop.start();
-	_fpsTime  = sys()->getTimeNs();
-	_fpsCount = 0;
+	_frameStats.startLoop(sys()->getTimeNs());
+	_statsTime       = sys()->getTimeNs();
+	_statsFrameCount = 0;
+	_textRebuilds    = 0;
 
-	startGame(0);
+	_tickInputs = 0;
+	_flow.resetHash();
+	if(_replaying) {
+		_inputLog.startReplay();
+		_flow.startLevel(_inputLog.level());
+	}
+	else {
+		_inputLog.startRecording(_tickRate, 0);
+		_flow.startLevel(0);
+	}
 
 	do {
 		switch(_loop.nextEvent()) {
-		case InterpLoop::Tick:
+		case InterpLoop::Tick: {
+			int64 begin = sys()->getTimeNs();
 			updateTick();
+			_frameStats.tick(begin, sys()->getTimeNs(), _loop.tickTime());
 			break;
+		}
 		case InterpLoop::Frame:
 			updateFrame();
 			break;
 		}
 	} while (_running);
 	_loop.stop();
+
+	const SimState& state = _sim.state();
+	if(_replaying)
+		verifyReplay();
+	else if(!game()->recordPath().empty()) {
+		_inputLog.setEnd(_flow.level(), state.score, state.distance, _flow.hash());
+		if(_inputLog.save(game()->recordPath(), log()))
+			log().info("Recorded ", _inputLog.tickCount(), " ticks to \"",
+			           game()->recordPath(), "\" (", _inputLog.byteSize(), " bytes)");
+	}
 }
 
 
@@ -376,75 +387,116 @@ Game* MainState::game() {
 
 
 unsigned MainState::shipShapeCount() const {
-	return _shipShapes.size() / _shipPartCount;
+	return _flow.shipDef().shapeCount();
 }
 
 
 Vector2 MainState::partExpectedPosition(unsigned shape, unsigned part) const {
-	unsigned index = shape * _shipPartCount + part;
-	assert(index < _shipShapes.size());
-	return _shipShapes[index] * _blockSize;
+	const ShipDef& shipDef = _flow.shipDef();
+	assert(shape < shipDef.shapeCount() && part < shipDef.partCount());
+	return Vector2(shipDef.shapeX(shape)[part], shipDef.shapeY(shape)[part]);
 }
 
 
 float MainState::warningScrollDist() const {
-	return _shipHSpeed;
+	return _sim.warningScrollDist();
 }
 
 
-void MainState::playAnimation(const std::string& name) {
-	if(_animations.isMember(name) && _animations[name].isArray()) {
-		_animCurrent = name;
-		_animStep = -1;
-		nextAnimationStep();
-	}
-	else {
-		log().error("Unable to play animation \"", name,"\".");
-	}
-}
+void MainState::levelStarted() {
+	PROFILE_ZONE("MainState::levelStarted");
+
+	if(_ship.isValid())
+		_entities.destroyEntity(_ship);
+
+	_anim.reset();
+
+	const Json::Value& info = _flow.levelInfo();
+	_mapRenderer.setBg(0, info["bg1"].asString());
+	_mapRenderer.setBg(1, info["bg2"].asString());
+	_map.setWarningColor(parseColor(info["warning_color"]));
+	_map.setPointColor(parseColor(info["point_color"]));
+	_levelColor  = parseColor(info["color"]);
+	_levelColor2 = parseColor(info["alt_color"]);
+	_beamColor   = parseColor(info["beam_color"]);
+	_laserColor  = parseColor(info["laser_color"]);
+	_textColor   = parseColor(info["text_color"]);
+
+	_shipSoundSample = 0;
+	_lastPointSound  = -ONE_SEC;
+
+	_ship = loadEntity("ship.json", _gameLayer);
+//	dbgLogger.error(_ship.name());
+	_ship.sprite()->setColor(_levelColor2);
+	_ship.sprite()->setTileIndex(4);
+
+//	EntityRef ship2 = _ship.firstChild();
+//	while(ship2.nextSibling().isValid()) ship2 = ship2.nextSibling();
+	EntityRef ship2 = _ship.clone(_ship);
+//	dbgLogger.error(ship2.name());
+	ship2.sprite()->setColor(_levelColor);
+	ship2.sprite()->setTileIndex(1);
+	ship2.place(Vector3(0, 0, 0));
 
+	const ShipDef& shipDef = _flow.shipDef();
+	const ShipParts& parts = _sim.state().parts;
 
-void MainState::updateAnimation(float time) {
-	if(_anim) {
-		float t = time + _animPos;
-//		dbgLogger.error("updateAnimation: ", time, ", ", t);
-		_anim->update(t);
-		_animPos = t;
+	_ship.place(Vector3(_sim.state().shipPos(0), _sim.state().shipPos(1), 0));
+	_shipPartCount = shipDef.partCount();
+	_shipParts.resize(_shipPartCount);
+	for (unsigned i = 0 ; i < _shipPartCount ; ++i)
+	{
+		const ShipPartDef& def = shipDef.part(i);
+		_shipParts[i] = _ship.clone(_ship, "shipPart");
+//		dbgLogger.error(_shipParts[i].name());
+		_shipParts[i].sprite()->setTileGridSize(Vector2i(3, 6));
+		_shipParts[i].sprite()->setTileIndex(def.tile);
+		_shipParts[i].sprite()->setColor(_levelColor2);
+		_shipParts[i].place(Vector3(parts.x[i], parts.y[i], 0));
+
+//		EntityRef part2 = _shipParts[i].firstChild();
+		EntityRef part2 = _shipParts[i].clone(_shipParts[i]);
+//		dbgLogger.error(part2.name());
+		part2.sprite()->setColor(_levelColor);
+		part2.sprite()->setTileIndex(def.baseTile);
+		part2.place(Vector3(0, 0, 0));
 	}
-	if(_animState == ANIM_PLAY && (!_anim || _animPos > _anim->length)) {
-		nextAnimationStep();
+
+	_texts.get(_scoreText)->setColor(_textColor);
+	_texts.get(_speedText)->setColor(_textColor);
+	_texts.get(_distanceText)->setColor(_textColor);
+	_texts.get(_dialogText)->setColor(_textColor);
+
+	{
+		PROFILE_ZONE("Load assets");
+		loader()->waitAll();
+		renderer()->uploadPendingTextures();
 	}
+
+//	audio()->playSound(assets()->getAsset("sound.ogg"), 2);
+//	Mix_RegisterEffect(MIX_CHANNEL_POST, shipSoundCb, NULL, this);
+
+	_charSprite.place(Vector3(-550, 0, 0));
+	_dialogBg.place(Vector3(SCREEN_WIDTH - 96, -450, 0));
+	_dialogText.place(Vector3(0, 0, 0));
+
+	_entities.updateWorldTransform();
 }
 
 
-void MainState::nextAnimationStep() {
-	float animLen = .4;
+void MainState::animationStep(const Json::Value* step) {
+	float animLen = GameFlow::ANIM_STEP_LENGTH;
 	float leftDialogPos = 1920 - 96;
 	float dialogY = 96;
 
-	const Json::Value& stepList = _animations[_animCurrent];
-	lairAssert(stepList.isArray());
-
-	++_animStep;
 	_anim.reset();
-	_animState = ANIM_NONE;
-	_pause = false;
-//	dbgLogger.error("nextAnimationStep:", _animCurrent, ":", _animStep);
-	if(_animStep < stepList.size()) {
+	if(step) {
 		try {
-			const Json::Value& step = stepList[_animStep];
-			if(!step.isArray()) {
-				log().error("Animation ", _animCurrent, ":", _animStep, " is not an array.");
-				return;
-			}
-			const std::string& cmd = step[0].asString();
-			_animPos = 0;
-			_animState = ANIM_PLAY;
-			_pause = true;
+			const std::string& cmd = (*step)[0].asString();
 //			dbgLogger.error("  play ", cmd);
 			if(cmd == "show_char") {
 				auto a = std::make_shared<CompoundAnim>();
-				_charSprite.sprite()->setTexture(step[1].asString());
+				_charSprite.sprite()->setTexture((*step)[1].asString());
 				a->addAnim(std::make_shared<MoveAnim>(
 				               animLen, _charSprite,
 				               _charSprite.transform().translation().head<2>(),
@@ -491,465 +543,107 @@ void MainState::nextAnimationStep() {
 				_anim = a;
 			}
 			if(cmd == "show_text") {
-				auto a = std::make_shared<CompoundAnim>();
 				_dialogText.place(Vector3(550, 475, 0));
-				_texts.get(_dialogText)->setText(step[1].asString());
-				_animState = ANIM_WAIT;
+				_texts.get(_dialogText)->setText((*step)[1].asString());
 			}
 		}
-		catch(Json::LogicError e) {
-			log().error("Animation ", _animCurrent, ":", _animStep, ": ", e.what());
-			return;
-		}
-	}
-}
-
-
-void MainState::endAnimation() {
-//	dbgLogger.error("endAnimation");
-	if(_animState == ANIM_WAIT) {
-		if(_anim) {
-			_anim->update(_anim->length);
-		}
-		nextAnimationStep();
-	}
-	else {
-		while(_animState == ANIM_PLAY) {
-			if(_anim) {
-				_anim->update(_anim->length);
-			}
-			nextAnimationStep();
+		catch(Json::LogicError& e) {
+			log().error("Animation step: ", e.what());
 		}
 	}
 }
 
 
-void MainState::startGame(int level) {
-	if(_ship.isValid())
-		_entities.destroyEntity(_ship);
-
-	_currentLevel = level % _mapInfo.size();
-
-	_pause = false;
-
-	_scrollPos     = 0;
-	_prevScrollPos = _scrollPos;
-	_levelFinished = false;
-
-	const Json::Value& info = _mapInfo[_currentLevel];
-	_map.setBg(0, info["bg1"].asString());
-	_map.setBg(1, info["bg2"].asString());
-	_map.setWarningColor(parseColor(info["warning_color"]));
-	_map.setPointColor(parseColor(info["point_color"]));
-	_levelColor  = parseColor(info["color"]);
-	_levelColor2 = parseColor(info["alt_color"]);
-	_beamColor   = parseColor(info["beam_color"]);
-	_laserColor  = parseColor(info["laser_color"]);
-	_textColor   = parseColor(info["text_color"]);
-
-	const Json::Value& mapAnims = info["anims"];
-	_mapAnims.clear();
-	for(int i = 0; i < mapAnims.size(); ++i) {
-		_mapAnims.push_back(std::make_pair(mapAnims[i][0].asInt(),
-		                                   mapAnims[i][1].asString()));
-	}
-	_mapAnimIndex = 0;
-
-	_deathTimer = -1;
-
-	_shipSoundSample = 0;
-	_lastPointSound  = -ONE_SEC;
-	_warningTileX    = 0;
-	_warningMap.assign(21, false);
-
-	_ship = loadEntity("ship.json", _gameLayer);
-//	dbgLogger.error(_ship.name());
-	_ship.place(Vector3(4*_blockSize, 11*_blockSize, 0));
-	_ship.sprite()->setColor(_levelColor2);
-	_ship.sprite()->setTileIndex(4);
-	_shipHSpeed = 2*_minShipHSpeed;
-	_shipVSpeed = 0;
-	_climbCharge = _thrustMaxCharge;
-	_diveCharge  = _thrustMaxCharge;
-
-//	EntityRef ship2 = _ship.firstChild();
-//	while(ship2.nextSibling().isValid()) ship2 = ship2.nextSibling();
-	EntityRef ship2 = _ship.clone(_ship);
-//	dbgLogger.error(ship2.name());
-	ship2.sprite()->setColor(_levelColor);
-	ship2.sprite()->setTileIndex(1);
-	ship2.place(Vector3(0, 0, 0));
-
-	_shipShape = 0;
-	_shipParts.resize(_shipPartCount);
-	_partAlive.resize(_shipPartCount);
-	for (int i = 0 ; i < _shipPartCount ; ++i)
-	{
-		_shipParts[i] = _ship.clone(_ship, "shipPart");
-//		dbgLogger.error(_shipParts[i].name());
-		_shipParts[i].sprite()->setTileGridSize(Vector2i(3, 6));
-		_shipParts[i].sprite()->setTileIndex(i + ((i<3)? 9: 12));
-		_shipParts[i].sprite()->setColor(_levelColor2);
-		Vector2 pos = partExpectedPosition(_shipShape, i);
-		_shipParts[i].place(Vector3(pos[0],pos[1],0));
-
-//		EntityRef part2 = _shipParts[i].firstChild();
-		EntityRef part2 = _shipParts[i].clone(_shipParts[i]);
-//		dbgLogger.error(part2.name());
-		part2.sprite()->setColor(_levelColor);
-		part2.sprite()->setTileIndex(i + ((i<3)? 0: 3));
-		part2.place(Vector3(0, 0, 0));
-
-		_partAlive[i] = true;
-	}
-
-	_distance = 0;
-	_score    = 0;
-
-	_texts.get(_scoreText)->setColor(_textColor);
-	_texts.get(_speedText)->setColor(_textColor);
-	_texts.get(_distanceText)->setColor(_textColor);
-	_texts.get(_dialogText)->setColor(_textColor);
-
-	loader()->waitAll();
-	renderer()->uploadPendingTextures();
-
-	// Need map images to be loaded.
-	//_map.generate(0, 300, .5, 1);
-	_map.clear();
-	const Json::Value& segments = info["segments"];
-	for(int i = 0; i < segments.size(); ++i) {
-		Path path = segments[i].asString();
-		if(!path.empty()) {
-			_map.appendSection(path);
-		}
-	}
-
-//	audio()->playSound(assets()->getAsset("sound.ogg"), 2);
-//	Mix_RegisterEffect(MIX_CHANNEL_POST, shipSoundCb, NULL, this);
-
-	_charSprite.place(Vector3(-550, 0, 0));
-	_dialogBg.place(Vector3(SCREEN_WIDTH - 96, -450, 0));
-	_dialogText.place(Vector3(0, 0, 0));
-	_prevFrameTime = _loop.tickTime();
-
-	_entities.updateWorldTransform();
-
-	_animState = ANIM_NONE;
+void MainState::animationUpdate(float time) {
+	if(_anim)
+		_anim->update(time);
 }
 
 
 void MainState::updateTick() {
+	PROFILE_ZONE("MainState::updateTick");
+
 	_inputs.sync();
 
 	if(_quitInput->justPressed()) {
 		quit();
 		return;
 	}
-	if(_restartInput->justPressed()) {
-		startGame((_currentLevel + 1) % _mapInfo.size());
-	}
 
-	bool alive = _deathTimer < 0;
-	if(!alive)
-		_deathTimer += _loop.tickDuration();
-
-	if(alive && _animState == ANIM_NONE && _mapAnimIndex < _mapAnims.size()
-	&& int(_scrollPos) >= _mapAnims[_mapAnimIndex].first) {
-		playAnimation(_mapAnims[_mapAnimIndex].second);
-		++_mapAnimIndex;
-	}
-
-	bool levelFinished = _scrollPos >= _map.length() * _blockSize;
-	bool levelSucceded = _score >= _mapInfo[_currentLevel].get("min_score", 0).asFloat();
-	if(alive && _animState == ANIM_NONE && levelFinished && !_levelFinished) {
-		std::string anim = _mapInfo[_currentLevel]
-		        .get(levelSucceded? "end_anim": "fail_anim", "").asString();
-		if(!anim.empty())
-			playAnimation(anim);
-	}
-	_levelFinished = levelFinished;
-
-	if(_skipInput->justPressed()) {
-		endAnimation();
-	}
-
-	// Gameplay
-	double time    = double(_loop.frameTime()) / double(ONE_SEC);
-	double tickDur = double(_loop.tickDuration()) / double(ONE_SEC);
-
-	if(_pause) {
-		_entities.updateWorldTransform();
-		return;
-	}
-
-	if(alive && _levelFinished) {
-		int next = _currentLevel + levelSucceded;
-		if(next >= _mapInfo.size()) {
-			game()->splashState()->setup(nullptr, "credits.png");
-			game()->setNextState(game()->splashState());
+	if(_replaying) {
+		if(!_inputLog.replay(&_tickInputs)) {
 			quit();
 			return;
 		}
-
-		startGame(next);
-		_entities.updateWorldTransform();
-		return;
-	}
-
-	if(_deathTimer > int64(ONE_SEC)) {
-		startGame(_currentLevel);
-		_entities.updateWorldTransform();
-		return;
-	}
-
-	// Shapeshift !
-	if(alive && _stretchInput->justPressed()) { ++_shipShape; }
-	if(alive && _shrinkInput->justPressed()) { --_shipShape; }
-	_shipShape = std::max(0, std::min(int(shipShapeCount()) - 1, int(_shipShape)));
-
-	// Horizontal control and physics.
-	if (alive && _accelInput->isPressed()) {
-		float damping = (1 + _shipHSpeed / _hSpeedDamping);
-		_shipHSpeed += _acceleration / (damping * damping);
 	}
-	if (alive && _brakeInput->isPressed())
-		_shipHSpeed = std::max(_shipHSpeed * _brakingFactor, _minShipHSpeed);
-
-	_shipHSpeed = std::max(_shipHSpeed, 0.f);
-	_scrollPos += _shipHSpeed * tickDur;
-	_distance  += _shipHSpeed * tickDur;
-
-	// Gathering parts
-	float magDrag = 0;
-	std::vector<Vector2> partSpeeds(_shipPartCount);
-	for (unsigned i = 0 ; i < _shipPartCount ; ++i)
-	{
-		if (!_partAlive[i]) { continue; }
-
-		Vector2 origin = partPosition(i),
-		   destination = partExpectedPosition(_shipShape, i);
-		Vector2 gap = destination - origin;
-
-		if (gap[1] > _snapDistance)
-			destroyPart(i);
-
-		float dist = gap.norm();
-		if (dist > _partBaseSpeed)
-			gap *= _partBaseSpeed / dist;
-
-		partSpeeds[i] = gap;
+	else {
+		Input* inputs[] = { _accelInput, _brakeInput, _climbInput, _diveInput,
+		                    _stretchInput, _shrinkInput, _skipInput, _restartInput };
+		_tickInputs = 0;
+		for(unsigned i = 0; i < REC_COUNT; ++i) {
+			if(inputs[i]->isPressed())
+				_tickInputs |= 1 << i;
+		}
+		_inputLog.record(_tickInputs);
 	}
 
-	// Vertical speed control and physics.
-	float& vspeed = _shipVSpeed;
-
-	// Recharging thrusters.
-	_climbCharge = std::min(_climbCharge + _thrustRateCharge, _thrustMaxCharge);
-	_diveCharge  = std::min(_diveCharge  + _thrustRateCharge, _thrustMaxCharge);
-
-	// Activating thrusters.
-	if (alive && _climbInput->justPressed()) {
-		vspeed += _climbCharge;
-		_climbCharge = 0;
+	if(_profileInput->justPressed()) {
+		Profiler::writeChromeTrace(PROFILE_FILE, log());
 	}
-	if (alive && _diveInput->justPressed()) {
-		vspeed -= _diveCharge;
-		_diveCharge = 0;
+	if(_statsInput->justPressed()) {
+		_showStats = !_showStats;
+		_texts.get(_statsText)->setText("");
 	}
-	if (alive && _climbInput->isPressed()) { vspeed += _thrustPower; }
-	if (alive && _diveInput->isPressed())  { vspeed -= _thrustPower; }
-
-	// Automatic vertical slowdown.
-	if ( alive && !(_climbInput->isPressed() || _diveInput->isPressed()) )
-		vspeed *= _vSpeedDamping;
-
-	if(alive) {
-		// Bouncing (or crashing) on walls.
-		float bump = collide(_shipPartCount);
-		if (bump == INFINITY) {
-			_deathTimer = 0;
-			audio()->playSound(_crashSound, 0, CHANN_CRASH);
-			dbgLogger.error("u ded. 'sploded hed");
-		}
-		else if (bump != 0)
-			vspeed = bump;
-
-		for (unsigned i = 0 ; i < _shipPartCount ; ++i)
-		{
-			if (!_partAlive[i]) { continue; }
-
-			bump = collide(i);
-			if (bump == INFINITY)
-				destroyPart(i);
-			else if (bump != 0)
-				partSpeeds[i] = Vector2(partSpeeds[i][0],bump);
-		}
-
-		// Looting
-		collect (_shipPartCount);
-		for (unsigned i = 0 ; i < _shipPartCount ; ++i)
-			if (_partAlive[i])
-				collect (i);
-
-		// Shifting parts.
-		for (unsigned i = 0 ; i < _shipPartCount ; i++)
-			if (_partAlive[i])
-			{
-				partPosition(i) += partSpeeds[i];
-				magDrag += partSpeeds[i][1];
-			}
+	if(_tilesInput->justPressed()) {
+		_mapRenderer.setTileRenderer(MapRenderer::TileRenderer((_mapRenderer.tileRenderer() + 1)
+		                                                       % MapRenderer::TILE_RENDERER_COUNT));
+		log().info("Tile renderer: ", MapRenderer::tileRendererName(_mapRenderer.tileRenderer()));
 	}
 
-	// In Soviet Russia, parts gather you !
-	vspeed += -magDrag * _massRatio;
-
-	// Clamping vertical speed.
-	if (std::abs(vspeed) > _vSpeedCap)
-		vspeed = std::min(std::max(vspeed, -_vSpeedCap), _vSpeedCap);
-
-
-	// Shifting ship.
-	if (alive)
-		shipPosition()[1] += vspeed;
-	else
-		shipPosition()[1] -= _partDropSpeed;
-
-	if(alive) {
-		// Halting ship and snapping to grid .
-		if (std::abs(vspeed) < _vSpeedFloor)
-			shipPosition()[1] -= _vLockFactor *
-			  (std::fmod(shipPosition()[1] + _blockSize/2,_blockSize) - _blockSize/2);
-	}
-
-	// Warning sound
-	int warningTileX = (_scrollPos + SCREEN_WIDTH + warningScrollDist()) / _blockSize;
-	int warningTileBegin = _map.beginIndex(std::max(0, _warningTileX-1));
-	int warningTileEnd   = _map.beginIndex(warningTileX);
-	for(int y = 1; y < 21; ++y) {
-		bool hasWall = _map.hasWallAtYInRange(y, warningTileBegin, warningTileEnd);
-		if(hasWall && !_warningMap[y]) {
-			audio()->playSound(_warningSound, 0, CHANN_WARNING);
-		}
-		_warningMap[y] = hasWall;
+	unsigned events = _flow.tick(_tickInputs);
+	if(events & FLOW_GAME_OVER) {
+		game()->splashState()->setup(nullptr, "credits.png");
+		game()->setNextState(game()->splashState());
+		quit();
+		return;
 	}
-	_warningTileX = std::max(warningTileX, _warningTileX);
-
-	_prevScrollPos = _scrollPos;
-	_entities.updateWorldTransform();
-}
-
-
-Box2 MainState::partBox (unsigned part)
-{
-	Vector2 partCorner = shipPosition(),
-	        partSize   = Vector2(_blockSize,_blockSize); // Buh.
-	if (part < _shipPartCount)
-	{
-		partCorner += partPosition(part);
-		partSize += Vector2(2 * _blockSize,0); // Ick !
+	if(!(events & FLOW_TICKED)) {
+		_entities.updateWorldTransform();
+		return;
 	}
 
-	partCorner += Vector2(_scrollPos,0);
-
-	return Box2(partCorner, partCorner + partSize);
-}
-
-
-// Check a part for collision, and return the strength of the vertical bump.
-// If the bump is INFINITY, the part has crashed.
-// If part == _shipPartCount, check the ship itself.
-float MainState::collide (unsigned part)
-{
-	float dvspeed = 0;
-
-	Box2 pBox = partBox(part);
-	float dScroll = _scrollPos - _prevScrollPos;
-
-	int firstBlock = _map.beginIndex((pBox.min()[0] - dScroll) / _blockSize),
-	     lastBlock = _map.beginIndex(pBox.min()[0] / _blockSize + 2);
-
-	for (int bi = firstBlock ; bi < lastBlock ; bi++)
-	{
-		Box2 hit = _map.hit(pBox, bi, dScroll);
-		float amount = hit.sizes()[1];
-
-		if (hit.isEmpty())
-			continue;
-
-		if (amount > _crashThreshold)
-			dvspeed = INFINITY;
-		else if (amount > _scratchThreshold)
-		{
-			if (hit.min()[1] > pBox.min()[1])
-				dvspeed = -amount / _bumpawayTime;
-			else
-				dvspeed = amount / _bumpawayTime;
-		}
+	if(events & SIM_CRASH) {
+		audio()->playSound(_crashSound, 0, CHANN_CRASH);
+		dbgLogger.error("u ded. 'sploded hed");
 	}
+	else if(events & SIM_PART_LOST)
+		audio()->playSound(_crashSound, 0, CHANN_CRASH);
 
-	return dvspeed;
-}
-
-
-void MainState::collect (unsigned part)
-{
-	Box2 pBox = partBox(part);
-	float dScroll = _scrollPos - _prevScrollPos;
-
-	int firstBlock = _map.beginIndex((pBox.min()[0] - dScroll) / _blockSize),
-	     lastBlock = _map.beginIndex(pBox.min()[0] / _blockSize + 2);
-
-	unsigned prevScore = _score;
-	for (int bi = firstBlock ; bi < lastBlock ; bi++)
-	{
-		if (_map.pickup(pBox, bi, dScroll).sizes()[1] > _crashThreshold)
-		{
-			_map.clearBlock(bi);
-			_score += (_shipHSpeed / 1000) - 1;
-
-			if(_lastPointSound + ONE_SEC / 15 < int64(_loop.tickTime())) {
-				audio()->playSound(_pointSound, 0, CHANN_POINT);
-				_lastPointSound = _loop.tickTime();
-			}
-		}
+	if((events & SIM_POINTS)
+	&& _lastPointSound + ONE_SEC / 15 < int64(_loop.tickTime())) {
+		audio()->playSound(_pointSound, 0, CHANN_POINT);
+		_lastPointSound = _loop.tickTime();
 	}
-}
-
-
-void MainState::destroyPart (unsigned part)
-{
-	assert (part < _shipPartCount);
-	assert (_partAlive[part]);
 
-	_partAlive[part] = false;
-	partPosition(part)[1] += _blockSize;
+	if(events & SIM_WARNING)
+		audio()->playSound(_warningSound, 0, CHANN_WARNING);
 
-	audio()->playSound(_crashSound, 0, CHANN_CRASH);
+	placeShipEntities();
+	_entities.updateWorldTransform();
 }
 
 
 void MainState::updateFrame() {
-//	double time = double(_loop.frameTime()) / double(ONE_SEC);
-	double etime = double(_loop.frameTime() - _prevFrameTime) / double(ONE_SEC);
-
-	char buff[BUFSIZE];
-
-	snprintf(buff, BUFSIZE, "%.0f m/s", _shipHSpeed);
-	_texts.get(_speedText)->setText(buff);
+	PROFILE_ZONE("MainState::updateFrame");
 
-	snprintf(buff, BUFSIZE, "%.2f km", _distance/1000);
-	_texts.get(_distanceText)->setText(buff);
-
-	snprintf(buff, BUFSIZE, "%.0f", _score*1000.0);
-	_texts.get(_scoreText)->setText(buff);
+//	double time = double(_loop.frameTime()) / double(ONE_SEC);
 
-	// Killin' parts !
-	for (unsigned i = 0 ; i < _shipPartCount ; ++i)
-		if (!_partAlive[i] && partPosition(i)[1] > -SCREEN_HEIGHT)
-			partPosition(i)[1] -= _partDropSpeed;
+	_frameStats.frame(sys()->getTimeNs());
 
-	updateAnimation(etime);
+	const SimState& state = _sim.state();
+	_textRebuilds += _speedHud   .update(state.shipHSpeed,      "%.0f m/s");
+	_textRebuilds += _distanceHud.update(state.distance / 1000, "%.2f km");
+	_textRebuilds += _scoreHud   .update(state.score * 1000.0,  "%.0f");
 
 	// Rendering
 	Context* glc = renderer()->context();
@@ -958,70 +652,119 @@ void MainState::updateFrame() {
 	glc->clear(gl::COLOR_BUFFER_BIT | gl::DEPTH_BUFFER_BIT);
 
 	_spriteRenderer.beginFrame();
+	_drawCalls.beginFrame();
 
-	float scroll = lerp(_loop.frameInterp(), _prevScrollPos, _scrollPos);
+	float scroll = lerp(_loop.frameInterp(), state.prevScrollPos, state.scrollPos);
 	float screenWidth = float(window()->width() * SCREEN_HEIGHT)
 	                  / window()->height();
-	_map.render(scroll, warningScrollDist(), screenWidth);
+	_mapRenderer.render(scroll, warningScrollDist(), screenWidth);
+
+	// The tiles are drawn from their own buffers, over the backgrounds and
+	// under everything else.
+	{
+		PROFILE_ZONE("SpriteRenderer::endFrame");
+		_spriteRenderer.endFrame(_camera.transform());
+	}
+	_mapRenderer.renderTiles(_camera.transform(), scroll, screenWidth);
+	_spriteRenderer.beginFrame();
+
 	renderBeams(_loop.frameInterp());
 	_sprites.render(_loop.frameInterp(), _camera);
-	_map.renderPreview(scroll, warningScrollDist(), screenWidth, 70);
+	_mapRenderer.renderPreview(scroll, warningScrollDist(), screenWidth, 70);
 	_texts.render(_loop.frameInterp());
 
-	_spriteRenderer.endFrame(_camera.transform());
+	{
+		PROFILE_ZONE("SpriteRenderer::endFrame");
+		_spriteRenderer.endFrame(_camera.transform());
+	}
+	_drawCalls.endFrame();
 
-	window()->swapBuffers();
+	int64 swapBegin = sys()->getTimeNs();
+	{
+		PROFILE_ZONE("Window::swapBuffers");
+		window()->swapBuffers();
+	}
+	int64 now = sys()->getTimeNs();
+	_frameStats.swap(swapBegin, now);
 	glc->setLogCalls(false);
 
-	uint64 now = sys()->getTimeNs();
-	++_fpsCount;
-	if(_fpsCount == FRAMERATE) {
-		log().info("Fps: ", _fpsCount * float(ONE_SEC) / (now - _fpsTime));
-		_fpsTime  = now;
-		_fpsCount = 0;
+	++_statsFrameCount;
+	if(_statsFrameCount == FRAMERATE) {
+		if(_showStats)
+			updateStatsText(now);
+		_drawCalls.resetAverage();
+		_statsTime       = now;
+		_statsFrameCount = 0;
+		_textRebuilds    = 0;
 	}
 
-	_prevFrameTime = _loop.frameTime();
 }
 
 
-void MainState::renderBeam(const Matrix4& trans, TextureSP tex, const Vector2& p0,
-                           const Vector2& p1, const Vector4& color,
+// The overlay is only laid out again every FRAMERATE frames, so that it does
+// not weigh on the frame times it shows.
+void MainState::updateStatsText(int64 now) {
+	char drawCalls[16] = "n/a";
+	if(DrawCallCounter::isAvailable())
+		snprintf(drawCalls, sizeof(drawCalls), "%.1f", _drawCalls.average());
+	char line[128];
+	snprintf(line, sizeof(line), "draw calls/frame %s  text rebuilds/s %.1f\n",
+	         drawCalls, _textRebuilds * float(ONE_SEC) / (now - _statsTime));
+	_texts.get(_statsText)->setText(_frameStats.report() + line);
+}
+
+
+void MainState::renderBeam(const Matrix4& trans, TextureSP tex, const Box2& texCoord,
+                           const Vector2& p0, const Vector2& p1, const Vector4& color,
                            float texOffset, unsigned row, unsigned rowCount) {
-	float width = tex->height() / rowCount;
+	// Size of the beams image, which may be in an atlas.
+	Vector2 imageSize = Vector2(tex->width(), tex->height()).cwiseProduct(texCoord.sizes());
+	float width = imageSize(1) / rowCount;
 	Vector2 n = p1 - p0;
 	float dist = n.norm();
 	n = n / dist * width / 2.f;
 	n = Vector2(-n(1), n(0));
 
-	Box2 texCoord(Vector2(texOffset, float(row) / float(rowCount)),
-	              Vector2(dist / tex->width() + texOffset,
-	                      float(row + 1) / float(rowCount)));
-
-//	_spriteRenderer.setDrawCall(tex, Texture::TRILINEAR, BLEND_ALPHA);
-
-	unsigned index = _spriteRenderer.vertexCount();
-	_spriteRenderer.addVertex(trans, p0 - n, color, texCoord.corner(Box2::TopLeft));
-	_spriteRenderer.addVertex(trans, p1 - n, color, texCoord.corner(Box2::TopRight));
-	_spriteRenderer.addVertex(trans, p0 + n, color, texCoord.corner(Box2::BottomLeft));
-	_spriteRenderer.addVertex(trans, p1 + n, color, texCoord.corner(Box2::BottomRight));
-
-	_spriteRenderer.addIndex(index + 0);
-	_spriteRenderer.addIndex(index + 1);
-	_spriteRenderer.addIndex(index + 2);
-	_spriteRenderer.addIndex(index + 2);
-	_spriteRenderer.addIndex(index + 1);
-	_spriteRenderer.addIndex(index + 3);
-
-	_spriteRenderer.endSprite();
+	// The image repeats along the beam, but an atlas does not wrap around, so
+	// the beam is cut where the image repeats.
+	float u0 = texOffset;
+	float u1 = texOffset + dist / imageSize(0);
+	float v0 = float(row)     / float(rowCount);
+	float v1 = float(row + 1) / float(rowCount);
+	for(float u = u0; u < u1; ) {
+		float base = std::floor(u);
+		float uEnd = std::min(base + 1, u1);
+		Vector2 q0 = p0 + (p1 - p0) * ((u    - u0) / (u1 - u0));
+		Vector2 q1 = p0 + (p1 - p0) * ((uEnd - u0) / (u1 - u0));
+		Box2 tc = TextureAtlas::map(texCoord, Box2(Vector2(u - base, v0),
+		                                           Vector2(uEnd - base, v1)));
+
+		unsigned index = _spriteRenderer.vertexCount();
+		_spriteRenderer.addVertex(trans, q0 - n, color, tc.corner(Box2::TopLeft));
+		_spriteRenderer.addVertex(trans, q1 - n, color, tc.corner(Box2::TopRight));
+		_spriteRenderer.addVertex(trans, q0 + n, color, tc.corner(Box2::BottomLeft));
+		_spriteRenderer.addVertex(trans, q1 + n, color, tc.corner(Box2::BottomRight));
+
+		_spriteRenderer.addIndex(index + 0);
+		_spriteRenderer.addIndex(index + 1);
+		_spriteRenderer.addIndex(index + 2);
+		_spriteRenderer.addIndex(index + 2);
+		_spriteRenderer.addIndex(index + 1);
+		_spriteRenderer.addIndex(index + 3);
+
+		_spriteRenderer.endSprite();
+		u = uEnd;
+	}
 }
 
 
 void MainState::renderBeams(float interp) {
-	TextureAspectSP texAspect = _beamsTex->aspect<TextureAspect>();
-	TextureSP tex = texAspect->get();
+	PROFILE_ZONE("MainState::renderBeams");
+
+	TextureSP tex = _beamsTex->get();
 
-	_spriteRenderer.setDrawCall(tex, Texture::TRILINEAR, BLEND_ALPHA);
+	// Atlas sub-rects are only padded for the first mip levels: no trilinear.
+	_spriteRenderer.setDrawCall(tex, Texture::BILINEAR, BLEND_ALPHA);
 	Matrix4 wt = lerp(interp,
 	                  _ship._get()->prevWorldTransform.matrix(),
 	                  _ship._get()->worldTransform.matrix());
@@ -1029,23 +772,23 @@ void MainState::renderBeams(float interp) {
 	Vector2 mid = mid4.head<2>();
 	Vector2 laserOffset(SCREEN_WIDTH, 0);
 
-	renderBeam(wt, tex, mid, mid + laserOffset, _laserColor, 0, 0, 2);
-	Vector2 shipPos[3];
-	for(int i = 0; i < 3; ++i) {
-		shipPos[i] = (wt * (mid4 + Vector4(_blockSize * i, 0, 0, 0))).head<2>();
-	}
-	for(int i = 0; i < _shipPartCount; ++i) {
-		if (!_partAlive[i]) { continue; }
+	renderBeam(wt, tex, _beamsTexCoord, mid, mid + laserOffset, _laserColor, 0, 0, 2);
+	const Matrix4 shipWt = wt;
+	for(unsigned i = 0; i < _shipPartCount; ++i) {
+		if (!_sim.state().parts.alive[i]) { continue; }
+		const ShipPartDef& def = _flow.shipDef().part(i);
 
 		Matrix4 wt = lerp(interp,
 		                  _shipParts[i]._get()->prevWorldTransform.matrix(),
 		                  _shipParts[i]._get()->worldTransform.matrix());
-		renderBeam(wt, tex, mid, mid + laserOffset, _laserColor, 0, 0, 2);
+		renderBeam(wt, tex, _beamsTexCoord, mid, mid + laserOffset, _laserColor, 0, 0, 2);
 
-		Vector4 pp(.25 * _blockSize, ((i < 3)? .25: .75) * _blockSize, 0, 1);
+		Vector4 pp(def.beamAnchor(0) * _blockSize, def.beamAnchor(1) * _blockSize, 0, 1);
 		Vector2 partPos = (wt * pp).head<2>();
+		Vector4 sp = mid4 + Vector4(_blockSize * def.beamSource, 0, 0, 0);
+		Vector2 shipPos = (shipWt * sp).head<2>();
 		float advance = float(_loop.frameTime()) / float(ONE_SEC) + i * .1;
-		renderBeam(Matrix4::Identity(), tex, shipPos[i%3], partPos, _beamColor,
+		renderBeam(Matrix4::Identity(), tex, _beamsTexCoord, shipPos, partPos, _beamColor,
 		           advance, 1, 2);
 	}
 }
@@ -1058,10 +801,13 @@ void MainState::resizeEvent() {
 	                     1));
 	_camera.setViewBox(viewBox);
 	renderer()->context()->viewport(0, 0, window()->width(), window()->height());
+	_sim.setScreenWidth(viewBox.max()(0));
 }
 
 
 EntityRef MainState::loadEntity(const Path& path, EntityRef parent, const Path& cd) {
+	PROFILE_ZONE("MainState::loadEntity");
+
 	Path localPath = make_absolute(cd, path);
 	log().info("Load entity \"", localPath, "\"");
 
@@ -1090,7 +836,7 @@ void shipSoundCb(int /*chan*/, void *stream, int len, void *udata) {
 	if(!snd) return;
 	const Mix_Chunk* chunk = snd->chunk();
 
-	float speed = 1 - std::exp(-state->_shipHSpeed / 1000);
+	float speed = 1 - std::exp(-state->_sim.state().shipHSpeed / 1000);
 	int max = (chunk->alen - len) / 2;
 	int sample = std::max(0, std::min(int(speed * max), max));
 	int16* dst = reinterpret_cast<int16*>(stream);
@@ -1107,14 +853,36 @@ void shipSoundCb(int /*chan*/, void *stream, int len, void *udata) {
 }
 
 
-Vec2 MainState::shipPosition()
-{
-	return _ship.transform().translation().head<2>();
+void MainState::verifyReplay() {
+	const InputLogHeader& end = _inputLog.header();
+	const SimState& state = _sim.state();
+	char hashes[40];
+	snprintf(hashes, sizeof(hashes), "%016llx (%016llx)",
+	         (unsigned long long)_flow.hash(), (unsigned long long)end.endHash);
+	if(!_inputLog.isReplayDone())
+		log().warning("Replay interrupted before its end.");
+	else if(unsigned(_flow.level()) == end.endLevel && _flow.hash() == end.endHash
+	&& state.score == end.endScore && state.distance == end.endDistance)
+		log().info("Replay verified: level ", _flow.level(), ", score ",
+		           state.score * 1000.0, ", distance ", state.distance,
+		           ", state hash ", hashes);
+	else {
+		log().error("Replay diverged: level ", _flow.level(), " (", end.endLevel,
+		            "), score ", state.score * 1000.0, " (", end.endScore * 1000.0,
+		            "), distance ", state.distance, " (", end.endDistance,
+		            "), state hash ", hashes);
+		if(!end.deterministic)
+			log().warning("The replay was not recorded by a SHAPEOUT_DETERMINISTIC build.");
+	}
 }
 
 
-Vec2 MainState::partPosition(unsigned part)
+// Move the ship and part entities to where the simulation put them.
+void MainState::placeShipEntities()
 {
-	assert (part < _shipPartCount);
-	return _shipParts[part].transform().translation().head<2>();
+	const SimState& state = _sim.state();
+	_ship.transform().translation().head<2>() = state.shipPos;
+	for (unsigned i = 0 ; i < _shipPartCount ; ++i)
+		_shipParts[i].transform().translation().head<2>()
+		        = Vector2(state.parts.x[i], state.parts.y[i]);
 }
@@ -38,8 +38,18 @@
 #include <lair/ec/bitmap_text_component.h>
 
 #include "animation.h"
+#include "texture_atlas.h"
+#include "draw_call_counter.h"
+#include "ship_parts.h"
+#include "hud_text.h"
+#include "simulation.h"
+#include "input_log.h"
+#include "profiler.h"
+#include "frame_stats.h"
 
 #include "map.h"
+#include "map_renderer.h"
+#include "game_flow.h"
 
 
 using namespace lair;
@@ -54,7 +64,7 @@ typedef std::vector<EntityRef> EntityVector;
 void shipSoundCb(int chan, void *stream, int len, void *udata);
 
 
-class MainState : public GameState {
+class MainState : public GameState, public GameFlowListener {
 public:
 	MainState(Game* game);
 	virtual ~MainState();
@@ -62,6 +72,8 @@ public:
 	virtual void initialize();
 	virtual void shutdown();
 
+	void setTickRate(unsigned rate);
+
 	virtual void run();
 	virtual void quit();
 
@@ -71,19 +83,18 @@ public:
 	Vector2 partExpectedPosition(unsigned shape, unsigned part) const;
 	float warningScrollDist() const;
 
-	void playAnimation(const std::string& name);
-	void updateAnimation(float time);
-	void nextAnimationStep();
-	void endAnimation();
+	virtual void levelStarted() override;
+	virtual void animationStep(const Json::Value* step) override;
+	virtual void animationUpdate(float time) override;
 
-	void startGame(int level);
 	void updateTick();
 	void updateFrame();
 
-	void renderBeam(const Matrix4& trans, TextureSP tex, const Vector2& p0,
-	                const Vector2& p1, const Vector4& color,
+	void renderBeam(const Matrix4& trans, TextureSP tex, const Box2& texCoord,
+	                const Vector2& p0, const Vector2& p1, const Vector4& color,
 	                float texOffset, unsigned row, unsigned rowCount);
 	void renderBeams(float interp);
+	void updateStatsText(int64 now);
 
 	void resizeEvent();
 
@@ -94,6 +105,8 @@ public:
 	const Matrix4& screenTransform() const { return _gameLayer.transform().matrix(); }
 
 	SpriteRenderer* spriteRenderer() { return &_spriteRenderer; }
+	const TextureAtlas& atlas() const { return _atlas; }
+	const FrameStats& frameStats() const { return _frameStats; }
 
 	// Callback to play ship soudn
 	friend void shipSoundCb(int chan, void *stream, int len, void *udata);
@@ -108,6 +121,9 @@ protected:
 //	AnimationComponentManager  _anims;
 	InputManager               _inputs;
 
+	TextureAtlas               _atlas;
+	DrawCallCounter            _drawCalls;
+
 	SlotTracker _slotTracker;
 
 	OrthographicCamera _camera;
@@ -115,9 +131,12 @@ protected:
 	bool       _initialized;
 	bool       _running;
 	InterpLoop _loop;
-	int64      _fpsTime;
-	unsigned   _fpsCount;
-	uint64     _prevFrameTime;
+	FrameStats _frameStats;
+	bool       _showStats;
+	int64      _statsTime;
+	unsigned   _statsFrameCount;
+	unsigned   _textRebuilds; // HUD texts laid out since _statsTime.
+	unsigned   _tickRate;
 
 	Input* _quitInput;
 	Input* _restartInput;
@@ -128,8 +147,20 @@ protected:
 	Input* _stretchInput;
 	Input* _shrinkInput;
 	Input* _skipInput;
+	Input* _tilesInput;
+	Input* _profileInput;
+	Input* _statsInput;
+
+	void verifyReplay();
 
-	AssetSP _beamsTex;
+	// The inputs that drive the game (see RecordedInput) are recorded to, or
+	// replayed from, _inputLog.
+	InputLog _inputLog;
+	bool     _replaying;
+	uint8    _tickInputs;
+
+	TextureAspectSP _beamsTex;
+	Box2            _beamsTexCoord;
 
 	enum SoundChannel {
 		CHANN_WARNING,
@@ -146,99 +177,40 @@ protected:
 	EntityRef    _scoreText;
 	EntityRef    _speedText;
 	EntityRef    _distanceText;
+	HudText      _scoreHud;
+	HudText      _speedHud;
+	HudText      _distanceHud;
 	EntityRef    _charSprite;
 	EntityRef    _dialogBg;
 	EntityRef    _dialogText;
+	EntityRef    _statsText;
 	EntityRef    _ship;
 	EntityVector _shipParts;
 
-	Json::Value  _mapInfo;
-	std::vector<std::pair<int, std::string>> _mapAnims;
-	int          _mapAnimIndex;
+	float        _blockSize;
 	Map          _map;
+	MapRenderer  _mapRenderer;
+	Simulation   _sim;
+	GameFlow     _flow;
 
-	enum AnimState {
-		ANIM_NONE,
-		ANIM_PLAY,
-		ANIM_WAIT
-	};
-
-	Json::Value  _animations;
-	AnimationSP  _anim;
-	float        _animPos;
-	AnimState    _animState;
-	std::string  _animCurrent;
-	int          _animStep;
+	AnimationSP  _anim; // Of the current step of _flow.
 
 	// Game states
-	Vec2 shipPosition();
-	Vec2 partPosition(unsigned part);
-	Box2 partBox (unsigned part);
+	void placeShipEntities();
 
-	int         _currentLevel;
 	std::vector<Vector4> _levelColors;
 
-	bool        _pause;
-
-	float       _prevScrollPos;
-	float       _scrollPos;
-	float       _distance;
-	bool        _levelFinished;
-	float       _score;
 	Vector4     _levelColor;
 	Vector4     _levelColor2;
 	Vector4     _beamColor;
 	Vector4     _laserColor;
 	Vector4     _textColor;
 
-	float       _shipHSpeed;
-	float       _shipVSpeed;
-	float       _climbCharge;
-	float       _diveCharge;
-
 	AssetWP     _shipSound;
 	int         _shipSoundSample;
 	int64       _lastPointSound;
-	int         _warningTileX;
-	std::vector<bool> _warningMap;
-
-	int64                _deathTimer;
-	std::vector<bool>    _partAlive;
-	unsigned             _shipShape;
-
-	// Happenings
-	float collide     (unsigned part);
-	void  collect     (unsigned part);
-	void  destroyPart (unsigned part);
-
-	// Constant params
-	std::vector<Vector2> _shipShapes;
-	unsigned _shipPartCount;
-
-	float _blockSize;
-
-	float _hSpeedDamping;
-	float _acceleration;
-	float _minShipHSpeed;
-	float _brakingFactor;
-
-	float _thrustMaxCharge;
-	float _thrustRateCharge;
-	float _thrustPower;
-
-	float _vSpeedDamping;
-	float _vSpeedFloor;
-	float _vSpeedCap;
-	float _vLockFactor;
-
-	float _scratchThreshold;
-	float _crashThreshold;
-	float _bumpawayTime;
-
-	float _partBaseSpeed;
-	float _partDropSpeed;
-	float _snapDistance;
-	float _massRatio;
+
+	unsigned    _shipPartCount; // Number of entities in _shipParts.
 };
 
 
@@ -19,19 +19,44 @@
  */
 
 
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <random>
 
-#include <lair/sys_sdl2/image_loader.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-#include <lair/ec/sprite_renderer.h>
+#include <lair/sys_sdl2/image_loader.h>
 
-#include "main_state.h"
+#include "blocks.h"
+#include "level_file.h"
+#include "parallel.h"
+#include "profiler.h"
 
 #include "map.h"
 
 
 #define NOHIT Box2(Vector2(0,0),Vector2(0,0))
 
+// Column of a wall that does not exist.
+#define NO_WALL std::numeric_limits<int>::max()
+
+// Columns an endless map is generated ahead of what is streamed.
+#define GENERATE_AHEAD 1024
+
+
+inline unsigned firstBit(uint32 mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
 
 Box2 offsetBox(const Box2& box, const Vector2& offset) {
 	Box2 b = box;
@@ -41,18 +66,30 @@ Box2 offsetBox(const Box2& box, const Vector2& offset) {
 }
 
 
-Map::Map(MainState* mainState)
-	: _state(mainState),
-      _length(0),
+Map::Map(LoaderManager* loader, float blockSize)
+	: _loader(loader),
+      _blockSize(blockSize),
+      _tilesTexCoord(Vector2(0, 0), Vector2(1, 1)),
       _hTiles(4),
       _vTiles(4),
-      _nRows (22){
+      _warningTexCoord(Vector2(0, 0), Vector2(1, 1)),
+      _endless(false),
+      _nRows (22),
+      _length(0),
+      _firstChunk(0),
+      _keepCol(NO_WALL),
+      _tileListener(nullptr) {
+	_rowWalls.resize(_nRows);
+	_rowPoints.resize(_nRows);
+	_warnEdge = -1;
+	_warnPrev.assign(_nRows, -1);
+	_warnNext.assign(_nRows, NO_WALL);
 }
 
 
 unsigned Map::beginIndex(int col) const {
-	return std::lower_bound(_blocks.begin(), _blocks.end(),
-	                 Block{ Vector2i(col, 0), WALL }, blockCmp) - _blocks.begin();
+	col = std::max(0, std::min(col, _length));
+	return col * _nRows;
 }
 
 
@@ -61,8 +98,35 @@ unsigned Map::endIndex(int col) const {
 }
 
 
+Map::BlockType Map::blockType(int i) const {
+	const Chunk* c = chunk(blockColumn(i));
+	if(!c)
+		return EMPTY;
+
+	unsigned ci = blockColumn(i) % CHUNK_SIZE;
+	uint32 bit = 1u << blockRow(i);
+	if(c->walls[ci] & bit)
+		return WALL;
+	if(c->points[ci] & bit)
+		return POINT;
+	return EMPTY;
+}
+
+
+uint32 Map::wallMask(int col) const {
+	const Chunk* c = chunk(col);
+	return c? c->walls[col % CHUNK_SIZE]: 0;
+}
+
+
+uint32 Map::pointMask(int col) const {
+	const Chunk* c = chunk(col);
+	return c? c->points[col % CHUNK_SIZE]: 0;
+}
+
+
 Box2 Map::hit(const Box2& box, int bi, float dScroll) const {
-	if (_blocks[bi].type != WALL)
+	if (blockType(bi) != WALL)
 		return NOHIT;
 
 	Box2 bb = blockBox(bi);
@@ -73,7 +137,7 @@ Box2 Map::hit(const Box2& box, int bi, float dScroll) const {
 
 
 Box2 Map::pickup(const Box2& box, int bi, float dScroll) {
-	if (_blocks[bi].type != POINT)
+	if (blockType(bi) != POINT)
 		return NOHIT;
 
 	Box2 bb = blockBox(bi);
@@ -85,32 +149,110 @@ Box2 Map::pickup(const Box2& box, int bi, float dScroll) {
 
 void Map::clearBlock(int bi)
 {
-	_blocks[bi].type = EMPTY;
+	int col = blockColumn(bi);
+	int row = blockRow(bi);
+	uint32 bit = 1u << row;
+	Chunk* c = chunk(col);
+	if(!c || !(c->points[col % CHUNK_SIZE] & bit))
+		return;
+
+	c->points[col % CHUNK_SIZE] &= ~bit;
+	if(_tileListener)
+		_tileListener->clearBlock(col, row);
+	RowIndex& index = _rowPoints[row];
+	index.erase(std::lower_bound(index.begin(), index.end(), col));
+}
+
+
+void Map::restorePoint(int bi)
+{
+	int col = blockColumn(bi);
+	int row = blockRow(bi);
+	uint32 bit = 1u << row;
+	Chunk* c = chunk(col);
+	if(!c || (c->points[col % CHUNK_SIZE] & bit))
+		return;
+
+	c->points[col % CHUNK_SIZE] |= bit;
+	RowIndex& index = _rowPoints[row];
+	index.insert(std::upper_bound(index.begin(), index.end(), col), col);
 }
 
 
+// begin and end are block indices, as returned by beginIndex().
 bool Map::hasWallAtYInRange(int y, int begin, int end) const {
-	for(int i = begin; i < end; ++i) {
-		if(_blocks[i].pos(1) == y && _blocks[i].type == WALL)
-			return true;
+	return nextWall(y, blockColumn(begin)) < blockColumn(end);
+}
+
+
+int Map::nextWall(unsigned row, int col) const {
+	return nextInRow(_rowWalls[row], col, _length);
+}
+
+
+int Map::nextPoint(unsigned row, int col) const {
+	return nextInRow(_rowPoints[row], col, _length);
+}
+
+
+float Map::sweepWall(unsigned row, float x0, float x1, float dx, int* col) const {
+	return (row < _nRows)? sweepRow(_rowWalls[row], x0, x1, dx, col): INFINITY;
+}
+
+
+float Map::sweepPoint(unsigned row, float x0, float x1, float dx, int* col) const {
+	return (row < _nRows)? sweepRow(_rowPoints[row], x0, x1, dx, col): INFINITY;
+}
+
+
+void Map::sweepWalls(unsigned row, float dx, SweptBox* boxes, unsigned count) const {
+	if(count == 0)
+		return;
+	if(row >= _nRows) {
+		for(unsigned i = 0; i < count; ++i)
+			boxes[i].toi = INFINITY;
+		return;
+	}
+
+	float x0 = boxes[0].x0;
+	for(unsigned i = 1; i < count; ++i)
+		x0 = std::min(x0, boxes[i].x0);
+
+	const RowIndex& index = _rowWalls[row];
+	RowIndex::const_iterator first =
+	        std::lower_bound(index.begin(), index.end(), int(std::floor(x0)));
+	for(unsigned i = 0; i < count; ++i) {
+		SweptBox& box = boxes[i];
+		int boxFirst = std::floor(box.x0);
+		RowIndex::const_iterator it = first;
+		while(it != index.end() && *it < boxFirst)
+			++it;
+
+		box.toi = (it != index.end() && *it < box.x1 + dx)?
+		              timeOfImpact(*it, box.x1, dx): INFINITY;
 	}
-	return false;
+}
+
+
+void Map::pointsInRow(unsigned row, int beginCol, int endCol, std::vector<int>& cols) const {
+	cols.clear();
+	if(row >= _nRows)
+		return;
+
+	const RowIndex& index = _rowPoints[row];
+	for(RowIndex::const_iterator it = std::lower_bound(index.begin(), index.end(), beginCol);
+	    it != index.end() && *it < endCol; ++it)
+		cols.push_back(*it);
 }
 
 
 Box2 Map::blockBox(int i) const {
-	const Block& b = _blocks[i];
-	Vector2 p = b.pos.cast<float>() * _state->blockSize();
-	return Box2(p, p + Vector2(_state->blockSize(), _state->blockSize()));
+	Vector2 p = Vector2(blockColumn(i), blockRow(i)) * _blockSize;
+	return Box2(p, p + Vector2(_blockSize, _blockSize));
 }
 
 
 void Map::initialize() {
-	AssetSP tilesAsset = _state->loader()->loadAsset<ImageLoader>("tiles.png");
-	_tilesTex = _state->renderer()->createTexture(tilesAsset);
-
-	AssetSP warningAsset = _state->loader()->loadAsset<ImageLoader>("warning.png");
-	_warningTex = _state->renderer()->createTexture(warningAsset);
 	registerSection("segment.png");
 	registerSection("segment_20.png");
 	registerSection("segment_19.png");
@@ -143,77 +285,164 @@ void Map::initialize() {
 }
 
 
-void Map::setBg(unsigned i, const Path& path) {
-	lairAssert(i < 3);
-	AssetSP bgAsset = _state->loader()->loadAsset<ImageLoader>(path);
-	_bgTex[i] = _state->renderer()->createTexture(bgAsset);
+void Map::setWarningColor(const Vector4& color) {
+	_warningColor = color;
 }
 
 
-void Map::setBgScroll(unsigned i, float scroll) {
-	lairAssert(i < 3);
-	_bgScroll[i] = scroll;
+void Map::setPointColor(const Vector4& color) {
+	_pointColor = color;
 }
 
 
-void Map::setWarningColor(const Vector4& color) {
-	_warningColor = color;
+void Map::registerSection(const Path& path) {
+	// Start loading now, the section is classified on first use.
+	if(_loader)
+		_loader->loadAsset<ImageLoader>(path);
+	_sections.push_back(path);
 }
 
 
-void Map::setPointColor(const Vector4& color) {
-	_pointColor = color;
+void Map::setTileListener(MapTileListener* listener) {
+	_tileListener = listener;
+	if(!_tileListener)
+		return;
+
+	_tileListener->clearTiles();
+	for(unsigned ci = 0; ci < _chunks.size(); ++ci) {
+		int first = (_firstChunk + ci) * CHUNK_SIZE;
+		pushTiles(first, _chunks[ci], std::min(int(CHUNK_SIZE), _length - first));
+	}
 }
 
 
-void Map::registerSection(const Path& path) {
-	AssetSP asset = _state->loader()->loadAsset<ImageLoader>(path);
-	_sections.push_back(asset->aspect<ImageAspect>());
+void Map::setTexCoords(const Box2& tilesTexCoord, const Box2& warningTexCoord) {
+	_tilesTexCoord   = tilesTexCoord;
+	_warningTexCoord = warningTexCoord;
 }
 
 
 void Map::clear() {
+	_generator.stop();
+	_endless = false;
+	_pool.clear();
+
 	_length = 0;
-	_blocks.clear();
+	_segments.clear();
+	_chunks.clear();
+	_firstChunk = 0;
+	_keepCol    = NO_WALL;
+	if(_tileListener)
+		_tileListener->clearTiles();
+	_warnEdge = -1;
+	_warnPrev.assign(_nRows, -1);
+	_warnNext.assign(_nRows, NO_WALL);
+	_levelFile.close();
+	for(unsigned row = 0; row < _nRows; ++row) {
+		_rowWalls[row].clear();
+		_rowPoints[row].clear();
+	}
 }
 
 
 void Map::appendSection(unsigned i) {
 	lairAssert(i < _sections.size());
-	const ImageSP img = _sections[i].lock()->get();
-	appendSection(img);
+	appendSection(_sections[i]);
 }
 
 
 void Map::appendSection(const ImageSP img) {
-	lairAssert(img->format() == Image::FormatRGBA8
-	        || img->format() == Image::FormatRGB8);
-	const uint8* pixels = reinterpret_cast<const uint8*>(img->data());
-	unsigned pxSize = Image::formatByteSize(img->format());
-	for(unsigned col = 0; col < img->width(); ++col) {
-		for(unsigned row = 0; row < img->height(); ++row) {
-			unsigned frow = img->height() - row - 1; // vertical flip
-			const uint8* pixel = pixels + ((col + frow*img->width()) * pxSize);
-			uint8 r = pixel[0];
-			uint8 g = pixel[1];
-			uint8 b = pixel[2];
-			if(r == 0 && g == 0 && b == 0) {
-				_blocks.push_back(Block{ Vector2i(_length, row), WALL });
-			}
-			if(r == 0 && g == 255 && b == 0) {
-				_blocks.push_back(Block{ Vector2i(_length, row), POINT });
-			}
-		}
-		_length += 1;
+	appendSection(classifySection(img));
+}
+
+
+// walls and points must stay valid until the next call to clear().
+void Map::appendColumns(const uint32* walls, const uint32* points, int count) {
+	if(count <= 0)
+		return;
+
+	_segments.push_back(Segment{ _length, count, nullptr, walls, points });
+	_length += count;
+}
+
+
+bool Map::loadCompiled(const Path& path, uint32 segmentsHash) {
+	clear();
+
+	if(!_levelFile.open(path))
+		return false;
+
+	const LevelFileHeader* header = checkLevelFile(_levelFile.data(), _levelFile.size(),
+	                                               _nRows, segmentsHash, path);
+	if(!header) {
+		_levelFile.close();
+		return false;
 	}
+
+	appendColumns(levelWalls(header), levelPoints(header), header->length);
+
+	return true;
 }
 
 
 void Map::appendSection(const Path& path) {
-	AssetSP asset = _state->loader()->loadAsset<ImageLoader>(path);
-	_state->loader()->waitAll();
-	ImageAspectSP aspect = asset->aspect<ImageAspect>();
-	appendSection(aspect->get());
+	appendSections(std::vector<Path>(1, path));
+}
+
+
+void Map::appendSections(const std::vector<Path>& paths) {
+	cacheSections(paths);
+
+	for(const Path& path: paths) {
+		SectionCache::const_iterator it = _sectionCache.find(path.utf8CStr());
+		if(it != _sectionCache.end())
+			appendSection(it->second);
+	}
+}
+
+
+// Load and classify all the sections that are not in the cache, waiting for
+// the loader only once.
+void Map::cacheSections(const std::vector<Path>& paths) {
+	lairAssert(_loader);
+	std::vector<std::pair<std::string, AssetSP>> toLoad;
+	for(const Path& path: paths) {
+		std::string key = path.utf8CStr();
+		if(_sectionCache.count(key))
+			continue;
+		_sectionCache[key] = nullptr;
+		toLoad.push_back(std::make_pair(key,
+		        _loader->loadAsset<ImageLoader>(path)));
+	}
+
+	if(!toLoad.empty()) {
+		PROFILE_ZONE("Map::cacheSections");
+		_loader->waitAll();
+
+		std::vector<ImageSP> images(toLoad.size());
+		for(unsigned i = 0; i < toLoad.size(); ++i) {
+			ImageAspectSP aspect = toLoad[i].second->aspect<ImageAspect>();
+			if(aspect)
+				images[i] = aspect->get();
+		}
+
+		// Sections are independent: classify them concurrently, the order
+		// only matters when they are appended below.
+		std::vector<SectionSP> sections(toLoad.size());
+		parallelFor(toLoad.size(), [&](unsigned i) {
+			if(images[i])
+				sections[i] = classifySection(images[i]);
+		});
+
+		for(unsigned i = 0; i < toLoad.size(); ++i) {
+			if(!sections[i]) {
+				dbgLogger.error("Failed to load section \"", toLoad[i].first, "\".");
+				_sectionCache.erase(toLoad[i].first);
+				continue;
+			}
+			_sectionCache[toLoad[i].first] = sections[i];
+		}
+	}
 }
 
 
@@ -221,148 +450,338 @@ void Map::generate(unsigned seed, unsigned minLength, float difficulty,
                    float variance) {
 	clear();
 
-	for(int i = 0; i < _sections.size(); ++i) {
-		appendSection(i);
+	cacheSections(_sections);
+	for(const Path& path: _sections) {
+		SectionCache::const_iterator it = _sectionCache.find(path.utf8CStr());
+		if(it != _sectionCache.end() && !it->second->walls.empty())
+			_pool.push_back(it->second);
 	}
-//	unsigned size = _sections.size();
-//	unsigned rangeSize = size * variance;
-//	unsigned begin = std::max(size - rangeSize, 0u);
-//	unsigned end   = std::min(begin + rangeSize, size);
 
-//	std::seed_seq seedSeq{ seed };
-//	std::mt19937 rEngine(seedSeq);
-//	std::uniform_int_distribution<unsigned> rand(begin, end-1);
+	// Sort the pool by wall density, our best guess of difficulty.
+	auto density = [](const SectionSP& section) {
+		unsigned count = 0;
+		for(uint32 walls: section->walls) {
+			for(; walls; walls &= walls - 1)
+				++count;
+		}
+		return float(count) / float(section->walls.size());
+	};
+	std::vector<std::pair<float, unsigned>> order;
+	for(unsigned i = 0; i < _pool.size(); ++i) {
+		order.push_back(std::make_pair(density(_pool[i]), i));
+	}
+	std::sort(order.begin(), order.end());
 
-//	while(_length < minLength) {
-//		appendSection(rand(rEngine));
-//	}
+	std::vector<SectionSP> pool;
+	std::vector<int> widths;
+	for(const auto& item: order) {
+		pool.push_back(_pool[item.second]);
+		widths.push_back(_pool[item.second]->walls.size());
+	}
+	_pool.swap(pool);
 
-//	std::sort(_blocks.begin(), _blocks.end(), blockCmp);
+	_generator.start(seed, widths, difficulty, variance, GENERATE_AHEAD);
+	if(minLength == 0) {
+		_endless = true;
+	}
+	else {
+		appendGenerated(minLength);
+		_generator.stop();
+	}
 }
 
 
-void Map::render(float scroll, float pDist, float screenWidth) {
-	SpriteRenderer* renderer = _state->spriteRenderer();
+void Map::appendGenerated(int endCol) {
+	if(!_generator.isRunning() || endCol <= _length)
+		return;
 
-	_state->renderer()->uploadPendingTextures();
+	std::vector<unsigned> indices;
+	_generator.take(endCol, indices);
+	for(unsigned i: indices) {
+		appendSection(_pool[i]);
+	}
+}
 
-	Matrix4 trans = _state->screenTransform();
-	Vector4 color(1, 1, 1, 1);
 
-	// Backgrounds
-	for(int i = 0; i < 3; ++i) {
-		if(!_bgTex[i] || !_bgTex[i]->get())
-			continue;
+Map::SectionSP Map::classifySection(const ImageSP img) const {
+	lairAssert(img->format() == Image::FormatRGBA8
+	        || img->format() == Image::FormatRGB8);
+	lairAssert(img->height() <= _nRows);
+
+	SectionSP section = std::make_shared<Section>();
+	section->walls .resize(img->width());
+	section->points.resize(img->width());
+
+	unsigned pxSize = Image::formatByteSize(img->format());
+	classifyColumns(reinterpret_cast<const uint8*>(img->data()), pxSize,
+	                img->width() * pxSize, img->width(), img->height(),
+	                0, img->width(), section->walls.data(), section->points.data());
 
-		TextureSP bgTex = _bgTex[i]->_get();
-		float bgScroll = scroll * _bgScroll[i] / bgTex->width();
-		Box2 bgBox(Vector2(0, 0), Vector2(1920, 1080));
-		Box2 bgTexBox(Vector2(bgScroll, 0), Vector2(bgScroll + 1920.f / bgTex->width(), 1));
-		renderer->addSprite(trans, bgBox, color, bgTexBox, bgTex,
-							Texture::TRILINEAR, BLEND_ALPHA);
+	return section;
+}
+
+
+void Map::appendSection(SectionSP section) {
+	int width = section->walls.size();
+	if(width == 0)
+		return;
+
+	_segments.push_back(Segment{ _length, width, section,
+	                             section->walls.data(), section->points.data() });
+	_length += width;
+}
+
+
+void Map::keepFrom(int col) {
+	_keepCol = std::max(col, 0);
+}
+
+
+void Map::stream(int beginCol, int endCol) {
+	if(_endless)
+		appendGenerated(endCol);
+
+	beginCol = std::max(0, std::min(beginCol, _length));
+	endCol   = std::max(beginCol, std::min(endCol, _length));
+
+	int beginChunk = std::min(beginCol, _keepCol) / CHUNK_SIZE;
+	int endChunk   = (endCol + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	while(!_chunks.empty() && _firstChunk < beginChunk) {
+		evictChunk();
+	}
+	if(_chunks.empty()) {
+		_firstChunk = std::max(_firstChunk, beginChunk);
 	}
 
-	// Warnings
-	float rightScroll = scroll + screenWidth;
-	unsigned wbeginCol = beginIndex(rightScroll / _state->blockSize() - screenWidth);
-	unsigned wendCol   = beginIndex((rightScroll + pDist) / _state->blockSize());
-	TextureSP warningTex = _warningTex->get();
-	std::vector<float> warnings(_nRows, 0);
-	for(unsigned i = wbeginCol; i < wendCol; ++i) {
-		const Block& b = _blocks[i];
-		if(b.pos(1) != 0 && b.pos(1) < 21 /*&& warnings[b.pos(1)] == 0*/ && b.type == WALL) {
-			float w = (b.pos(0) + 1) * _state->blockSize() - scroll - screenWidth;
-			w = (w > 0)? 1 - w / pDist: 1 + w / screenWidth;
-			warnings[b.pos(1)] = std::max(warnings[b.pos(1)], w);
-		}
+	while(_firstChunk + int(_chunks.size()) < endChunk) {
+		materializeChunk();
 	}
+}
+
+
+// The intensity of a wall grows up to the right edge of the screen and
+// decreases after, so each row only needs the nearest walls on each side
+// of the edge.
+void Map::buildWarnings(float scroll, float pDist, float screenWidth, QuadVector& quads) {
+	float rightScroll = scroll + screenWidth;
+	int wbeginCol = blockColumn(beginIndex(scroll / _blockSize));
+	int wendCol   = blockColumn(beginIndex((rightScroll + pDist) / _blockSize));
+	updateWarnings(std::floor(rightScroll / _blockSize) - 1);
+
 	Vector4 wColor = _warningColor;
 	wColor(3) *= .7;
 	for(unsigned i = 1; i < _nRows-1; ++i) {
-		if(warnings[i] > 0) {
-			Box2 pos(Vector2(screenWidth * (1 - warnings[i]), i * _state->blockSize()),
-			         Vector2(screenWidth * (2 - warnings[i]), (i+1) * _state->blockSize()));
-			Box2 texCoord(Vector2(0, 0), Vector2(1, 1));
-			renderer->addSprite(trans, pos, wColor, texCoord, warningTex,
-			                    Texture::TRILINEAR, BLEND_ALPHA);
+		float warning = 0;
+		int cols[2] = { _warnPrev[i], _warnNext[i] };
+		for(int col: cols) {
+			if(col < wbeginCol || col >= wendCol)
+				continue;
+			float w = (col + 1) * _blockSize - scroll - screenWidth;
+			w = (w > 0)? 1 - w / pDist: 1 + w / screenWidth;
+			warning = std::max(warning, w);
+		}
+
+		if(warning > 0) {
+			Box2 pos(Vector2(screenWidth * (1 - warning), i * _blockSize),
+			         Vector2(screenWidth * (2 - warning), (i+1) * _blockSize));
+			quads.push_back(Quad{ pos, _warningTexCoord, wColor });
 		}
 	}
+}
 
-	// Tiles
-	TextureSP tilesTex = _tilesTex->_get();
-	Vector2 tileSize(1. / _hTiles, 1. / _vTiles);
 
-	unsigned beginCol = scroll / _state->blockSize();
-	unsigned endCol   = beginCol + 41;
-	unsigned i = beginIndex(beginCol);
-	while(i < _blocks.size() && _blocks[i].pos(0) < endCol) {
-		unsigned ti = _blocks[i].type;
-		Vector2 tilePos(float(ti % _hTiles) / float(_hTiles),
-		                float(ti / _hTiles) / float(_vTiles));
-		Box2 texCoord(tilePos, tilePos + tileSize);
-		Box2 coords = offsetBox(blockBox(i), Vector2(-scroll, 0));
-		renderer->addSprite(trans, coords, color, texCoord, tilesTex,
-		                    Texture::TRILINEAR, BLEND_ALPHA);
-		++i;
+void Map::buildTiles(float scroll, QuadVector& quads) const {
+	Vector4 color(1, 1, 1, 1);
+	int beginCol = blockColumn(beginIndex(scroll / _blockSize));
+	int endCol   = blockColumn(endIndex(beginCol));
+	for(int col = beginCol; col < endCol; ++col) {
+		uint32 mask = wallMask(col) | pointMask(col);
+		while(mask) {
+			unsigned row = firstBit(mask);
+			mask &= mask - 1;
+			unsigned i  = col * _nRows + row;
+			Box2 texCoord = tileTexCoord(blockType(i));
+			Box2 coords = offsetBox(blockBox(i), Vector2(-scroll, 0));
+			quads.push_back(Quad{ coords, texCoord, color });
+		}
 	}
 }
 
 
-void Map::renderPreview(float scroll, float pDist, float screenWidth, float pWidth) {
-	SpriteRenderer* renderer = _state->spriteRenderer();
+void Map::buildPreview(float scroll, float pDist, float screenWidth, float pWidth,
+                       QuadVector& quads) const {
+	float rightScroll = scroll + screenWidth;
+	int beginCol = blockColumn(beginIndex(rightScroll / _blockSize));
+	int endCol   = blockColumn(beginIndex((rightScroll + pDist) / _blockSize));
+
+	for(unsigned row = 1; row < _nRows-1; ++ row) {
+		int wallCol  = std::min(nextWall (row, beginCol), endCol);
+		int pointCol = nextPoint(row, beginCol);
+		unsigned blocks[2];
+		unsigned count = 0;
+		if(pointCol < wallCol)
+			blocks[count++] = pointCol * _nRows + row;
+		if(wallCol < endCol)
+			blocks[count++] = wallCol * _nRows + row;
+
+		for(unsigned bi = 0; bi < count; ++bi) {
+			unsigned i = blocks[bi];
+			unsigned ti = blockType(i) + PREVIEW_OFFSET;
+			Box2 texCoord = tileTexCoord(ti);
+			Box2 coords = blockBox(i);
+			float scale = ((ti == PREVIEW_OFFSET)? 2: 1.2) - (coords.max()(0) - scroll - screenWidth) / pDist;
+
+			coords.min()(0) = (coords.min()(0) - rightScroll) * pWidth / pDist
+							+ screenWidth - pWidth - _blockSize;
+			coords.max()(0) = coords.min()(0) + _blockSize;
+
+			Vector2 a(coords.max()(0), (coords.min()(1) + coords.max()(1)) / 2);
+			coords.min() = (coords.min() - a) * scale + a;
+			coords.max() = (coords.max() - a) * scale + a;
+
+			Vector4 color = (ti == PREVIEW_OFFSET)? _warningColor: _pointColor;
+			quads.push_back(Quad{ coords, texCoord, color });
+		}
+	}
+}
+
 
-	Matrix4 trans = _state->screenTransform();
-	TextureSP tilesTex = _tilesTex->_get();
+Box2 Map::tileTexCoord(unsigned ti) const {
 	Vector2 tileSize(1. / _hTiles, 1. / _vTiles);
+	Vector2 tilePos(float(ti % _hTiles) / float(_hTiles),
+	                float(ti / _hTiles) / float(_vTiles));
+	Vector2 size = _tilesTexCoord.sizes();
+	return Box2(_tilesTexCoord.min() + size.cwiseProduct(tilePos),
+	            _tilesTexCoord.min() + size.cwiseProduct(tilePos + tileSize));
+}
 
-	float rightScroll = scroll + screenWidth;
-	unsigned beginCol = beginIndex(rightScroll / _state->blockSize());
-	unsigned endCol   = beginIndex((rightScroll + pDist) / _state->blockSize());
 
-	std::vector<unsigned> blocks;
-	for(unsigned row = 1; row < _nRows-1; ++ row) {
-		bool gotPoint = false;
-		for(unsigned i = beginCol; i < endCol; ++i) {
-			const Block& b = _blocks[i];
-			if(b.pos(1) == row) {
-				if(b.type == WALL) {
-					blocks.push_back(i);
-					break;
-				}
-				if(b.type == POINT && !gotPoint) {
-					blocks.push_back(i);
-					gotPoint = true;
-				}
-			}
+int Map::nextInRow(const RowIndex& index, int col, int length) {
+	RowIndex::const_iterator it = std::lower_bound(index.begin(), index.end(), col);
+	return (it != index.end())? *it: length;
+}
+
+
+// The first block that can be hit is the one under the left side of the box,
+// so blocks the box already overlaps have a time of impact of 0.
+float Map::sweepRow(const RowIndex& index, float x0, float x1, float dx, int* col) const {
+	int first = std::floor(x0);
+	int hitCol = nextInRow(index, first, _length);
+	if(hitCol >= _length || hitCol >= x1 + dx)
+		return INFINITY;
+
+	if(col)
+		*col = hitCol;
+	return timeOfImpact(hitCol, x1, dx);
+}
+
+
+// Time of impact of a box which right side is at x1 and which moves by dx with
+// the block in column col.
+float Map::timeOfImpact(int col, float x1, float dx) {
+	return (col < x1)? 0: (col - x1) / dx;
+}
+
+
+const Map::Chunk* Map::chunk(int col) const {
+	int ci = col / CHUNK_SIZE - _firstChunk;
+	if(col < 0 || ci < 0 || ci >= int(_chunks.size()))
+		return nullptr;
+	return &_chunks[ci];
+}
+
+
+Map::Chunk* Map::chunk(int col) {
+	int ci = col / CHUNK_SIZE - _firstChunk;
+	if(col < 0 || ci < 0 || ci >= int(_chunks.size()))
+		return nullptr;
+	return &_chunks[ci];
+}
+
+
+void Map::materializeChunk() {
+	int first = (_firstChunk + int(_chunks.size())) * CHUNK_SIZE;
+	int end   = std::min(first + int(CHUNK_SIZE), _length);
+
+	_chunks.push_back(Chunk());
+	Chunk& chunk = _chunks.back();
+
+	// Last segment starting at or before first.
+	SegmentVector::const_iterator seg = std::upper_bound(
+	            _segments.begin(), _segments.end(), first,
+	            [](int col, const Segment& s) { return col < s.begin; }) - 1;
+
+	for(int col = first; col < end; ++seg) {
+		int segEnd = std::min(seg->begin + seg->width, end);
+		std::copy(seg->walls  + (col - seg->begin), seg->walls  + (segEnd - seg->begin),
+		          chunk.walls  + (col - first));
+		std::copy(seg->points + (col - seg->begin), seg->points + (segEnd - seg->begin),
+		          chunk.points + (col - first));
+		col = segEnd;
+	}
+
+	for(int col = first; col < end; ++col) {
+		uint32 walls  = chunk.walls [col - first];
+		uint32 points = chunk.points[col - first];
+		while(walls) {
+			unsigned row = firstBit(walls);
+			walls &= walls - 1;
+			_rowWalls[row].push_back(col);
+			if(col > _warnEdge)
+				_warnNext[row] = std::min(_warnNext[row], col);
+			else
+				_warnPrev[row] = std::max(_warnPrev[row], col);
+		}
+		while(points) {
+			_rowPoints[firstBit(points)].push_back(col);
+			points &= points - 1;
 		}
 	}
 
-	for(unsigned bi = 0; bi < blocks.size(); ++bi) {
-		unsigned i = blocks[bi];
-		unsigned ti = _blocks[i].type + PREVIEW_OFFSET;
-		Vector2 tilePos(float(ti % _hTiles) / float(_hTiles),
-						float(ti / _hTiles) / float(_vTiles));
-		Box2 texCoord(tilePos, tilePos + tileSize);
-		Box2 coords = blockBox(i);
-		float scale = ((ti == PREVIEW_OFFSET)? 2: 1.2) - (coords.max()(0) - scroll - screenWidth) / pDist;
-
-		coords.min()(0) = (coords.min()(0) - rightScroll) * pWidth / pDist
-						+ screenWidth - pWidth - _state->blockSize();
-		coords.max()(0) = coords.min()(0) + _state->blockSize();
-
-		Vector2 a(coords.max()(0), (coords.min()(1) + coords.max()(1)) / 2);
-		coords.min() = (coords.min() - a) * scale + a;
-		coords.max() = (coords.max() - a) * scale + a;
-
-		Vector4 color = (ti == PREVIEW_OFFSET)? _warningColor: _pointColor;
-		renderer->addSprite(trans, coords, color, texCoord, tilesTex,
-							Texture::TRILINEAR, BLEND_ALPHA);
+	pushTiles(first, chunk, std::max(end - first, 0));
+}
+
+
+// Move the nearest walls on each side of the right edge of the screen to a new
+// edge column. The walls between the previous and the new edge are skipped
+// with a search in the row index, and only in the rows that have some.
+void Map::updateWarnings(int edgeCol) {
+	bool backward = edgeCol < _warnEdge;
+	_warnEdge = edgeCol;
+	for(unsigned row = 0; row < _nRows; ++row) {
+		if(!backward && _warnNext[row] > edgeCol)
+			continue;
+
+		const RowIndex& index = _rowWalls[row];
+		RowIndex::const_iterator it = std::upper_bound(index.begin(), index.end(), edgeCol);
+		_warnNext[row] = (it != index.end())?   *it:       NO_WALL;
+		_warnPrev[row] = (it != index.begin())? *(it - 1): -1;
 	}
 }
 
 
-bool Map::blockCmp(const Block& b0, const Block& b1) {
-	return  b0.pos(0) <  b1.pos(0)
-	    || (b0.pos(0) == b1.pos(0) && b0.pos(1) < b1.pos(1));
+void Map::pushTiles(int firstCol, const Chunk& chunk, unsigned count) {
+	if(_tileListener)
+		_tileListener->pushChunk(firstCol, chunk.walls, chunk.points, count);
 }
 
+
+void Map::evictChunk() {
+	_chunks.pop_front();
+	if(_tileListener)
+		_tileListener->popChunk();
+	++_firstChunk;
+
+	int firstCol = _firstChunk * CHUNK_SIZE;
+	while(!_segments.empty()
+	   && _segments.front().begin + _segments.front().width <= firstCol)
+		_segments.pop_front();
+
+	for(unsigned row = 0; row < _nRows; ++row) {
+		while(!_rowWalls[row].empty() && _rowWalls[row].front() < firstCol)
+			_rowWalls[row].pop_front();
+		while(!_rowPoints[row].empty() && _rowPoints[row].front() < firstCol)
+			_rowPoints[row].pop_front();
+	}
+}
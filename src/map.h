@@ -23,20 +23,40 @@
 #define _LD35_MAP_H
 
 
+#include <deque>
+#include <unordered_map>
+
 #include <lair/core/lair.h>
 #include <lair/core/log.h>
 
-#include <lair/render_gl2/texture.h>
+#include <lair/sys_sdl2/image_loader.h>
 
+#include "mapped_file.h"
+#include "generator.h"
 
-using namespace lair;
 
-class MainState;
+using namespace lair;
 
 
 Box2 offsetBox(const Box2& box, const Vector2& offset);
 
 
+// Told which columns the map materializes and evicts, to keep a copy of its
+// tiles (see MapRenderer). Chunks are pushed and popped in column order.
+class MapTileListener {
+public:
+	virtual ~MapTileListener() = default;
+
+	virtual void clearTiles() = 0;
+	virtual void pushChunk(int firstCol, const uint32* walls, const uint32* points,
+	                       unsigned count) = 0;
+	virtual void popChunk() = 0;
+	virtual void clearBlock(int col, unsigned row) = 0;
+};
+
+
+// The blocks of a level, streamed by chunks of columns, and the queries the
+// simulation makes on them. Drawing is done by MapRenderer, in the game.
 class Map {
 public:
 	enum BlockType {
@@ -47,25 +67,89 @@ public:
 		PREVIEW_OFFSET = 12,
 	};
 
+	enum {
+		CHUNK_SIZE = 64, // Columns per chunk.
+	};
+
 public:
-	Map(MainState* mainState);
+	// loader may be null if sections are never loaded from images (compiled
+	// or generated levels only).
+	Map(LoaderManager* loader, float blockSize);
 
+	// Blocks are indexed column-major: i = col * nRows + row. Indices are
+	// dense, so the blocks of a column range are a contiguous index range.
 	unsigned beginIndex(int col) const;
 	unsigned endIndex(int col) const;
 
+	int blockColumn(int i) const { return i / int(_nRows); }
+	int blockRow   (int i) const { return i % int(_nRows); }
+	BlockType blockType(int i) const;
+
 	Box2 blockBox(int i) const;
 	int length() const { return _length; }
+	unsigned rowCount() const { return _nRows; }
+	// Layout of the tiles image, in tiles.
+	unsigned hTiles() const { return _hTiles; }
+	unsigned vTiles() const { return _vTiles; }
+	float blockSize() const { return _blockSize; }
+	bool isEndless() const { return _endless; }
+
+	// Masks of the walls (resp. points) of a column, one bit per row. Columns
+	// that are not materialized are empty.
+	uint32 wallMask (int col) const;
+	uint32 pointMask(int col) const;
 
 	Box2 hit(const Box2& box, int bi, float dScroll) const;
 	Box2 pickup(const Box2& box, int bi, float dScroll);
 	void clearBlock(int bi);
+	// Put back a point removed by clearBlock(), to try several moves from the
+	// same state. The tile listener is not told.
+	void restorePoint(int bi);
 
 	bool hasWallAtYInRange(int y, int begin, int end) const;
 
+	// First materialized column >= col that contains a wall (resp. a point)
+	// in row, or length() if there is none. O(log n) in the number of such
+	// blocks.
+	int nextWall (unsigned row, int col) const;
+	int nextPoint(unsigned row, int col) const;
+
+	// Sweep a box spanning columns [x0, x1) by dx >= 0 columns and return the
+	// time of impact, as a fraction of dx in [0, 1], with the first wall
+	// (resp. point) of row in its way, or INFINITY if there is none. Sets
+	// *col to the column of that block. This is a lookup in the row index, so
+	// the cost does not depend on dx.
+	float sweepWall (unsigned row, float x0, float x1, float dx, int* col = nullptr) const;
+	float sweepPoint(unsigned row, float x0, float x1, float dx, int* col = nullptr) const;
+
+	// A box spanning columns [x0, x1), swept by sweepWalls().
+	struct SweptBox {
+		float x0;
+		float x1;
+		float toi; // Set by sweepWalls().
+	};
+
+	// Sweep count boxes by dx at once against the walls of row and set their
+	// toi as sweepWall() would. The row index is searched once for all the
+	// boxes, which are expected to be close to each other.
+	void sweepWalls(unsigned row, float dx, SweptBox* boxes, unsigned count) const;
+
+	// Set cols to the columns in [beginCol, endCol) with a point in row.
+	void pointsInRow(unsigned row, int beginCol, int endCol, std::vector<int>& cols) const;
+
 	void initialize();
+	// Sections can only be appended from images, or generated, with a loader.
+	bool hasLoader() const { return _loader; }
 	void registerSection(const Path& path);
-	void setBg(unsigned i, const Path& path);
-	void setBgScroll(unsigned i, float scroll);
+
+	// The listener gets the chunks that are already materialized first. It
+	// may be null.
+	void setTileListener(MapTileListener* listener);
+
+	// Where the tiles and warning images are in their textures, for the
+	// quads built below.
+	void setTexCoords(const Box2& tilesTexCoord, const Box2& warningTexCoord);
+	Box2 tileTexCoord(unsigned ti) const;
 
 	void setWarningColor(const Vector4& color);
 	void setPointColor(const Vector4& color);
@@ -74,44 +158,133 @@ public:
 	void appendSection(unsigned i);
 	void appendSection(const ImageSP aspect);
 	void appendSection(const Path& path);
+	void appendSections(const std::vector<Path>& paths);
+	void appendColumns(const uint32* walls, const uint32* points, int count);
+	bool loadCompiled(const Path& path, uint32 segmentsHash);
+	// Fill the map with registered sections picked at random, from the
+	// easiest (fewest walls) to the hardest as the map goes on. If minLength
+	// is 0, the map is endless and sections are picked on a worker thread
+	// ahead of stream() requests. The map only depends on the parameters.
 	void generate(unsigned seed, unsigned minLength, float difficulty,
 	              float variance=.3);
 
+	// Make sure columns [beginCol, endCol) are materialized and evict the
+	// chunks before beginCol. Scrolling only goes forward: evicted chunks
+	// are never materialized again until clear() is called.
+	void stream(int beginCol, int endCol);
+	// Do not evict the chunks from col on, for ships that are streamed in
+	// turn on the same map. clear() cancels it.
+	void keepFrom(int col);
+	// The first column that may be materialized.
+	int firstColumn() const { return _firstChunk * CHUNK_SIZE; }
+
 	void updateComming(float scroll, float pDist, float screenWidth);
-	void render(float scroll, float pDist, float screenWidth);
-	void renderPreview(float scroll, float pDist, float screenWidth, float pWidth);
+
+	// A sprite drawn by MapRenderer, in screen coordinates.
+	struct Quad {
+		Box2    coords;
+		Box2    texCoord;
+		Vector4 color;
+	};
+	typedef std::vector<Quad> QuadVector;
+
+	// Append the quads of the warnings, of the tiles (with TILES_SPRITES) and
+	// of the preview to quads. This is the CPU side of the rendering, which
+	// does not need a GL context.
+	void buildWarnings(float scroll, float pDist, float screenWidth, QuadVector& quads);
+	void buildTiles(float scroll, QuadVector& quads) const;
+	void buildPreview(float scroll, float pDist, float screenWidth, float pWidth,
+	                  QuadVector& quads) const;
 
 private:
-	struct Block {
-		Vector2i  pos;
-		BlockType type;
+	typedef std::vector<uint32> ColumnVector;
+
+	// The column masks of a section image. Sections are classified once and
+	// cached by path, so appending one is just a reference to its masks.
+	struct Section {
+		ColumnVector walls;
+		ColumnVector points;
+	};
+	typedef std::shared_ptr<Section> SectionSP;
+	typedef std::unordered_map<std::string, SectionSP> SectionCache;
+
+	SectionSP classifySection(const ImageSP img) const;
+	void cacheSections(const std::vector<Path>& paths);
+	void appendSection(SectionSP section);
+	void appendGenerated(int endCol);
+
+	// A range of columns appended to the map, either from a section or
+	// from a compiled level (in which case section is null). Blocks are
+	// copied when the chunks it covers are materialized.
+	struct Segment {
+		int           begin;
+		int           width;
+		SectionSP     section;
+		const uint32* walls;
+		const uint32* points;
+	};
+	typedef std::deque<Segment> SegmentVector;
+
+	// One bit per row, bit 0 being the bottom row.
+	struct Chunk {
+		uint32 walls [CHUNK_SIZE];
+		uint32 points[CHUNK_SIZE];
 	};
-	typedef std::vector<Block> BlockVector;
+	typedef std::deque<Chunk> ChunkDeque;
+
+	const Chunk* chunk(int col) const;
+	Chunk* chunk(int col);
+	void materializeChunk();
+	void evictChunk();
+	void pushTiles(int firstCol, const Chunk& chunk, unsigned count);
+	void updateWarnings(int edgeCol);
+
+	// Sorted columns of the walls (or points) of a given row.
+	typedef std::deque<int>        RowIndex;
+	typedef std::vector<RowIndex>  RowIndexVector;
 
-	static bool blockCmp(const Block& b0, const Block& b1);
+	static int nextInRow(const RowIndex& index, int col, int length);
+	float sweepRow(const RowIndex& index, float x0, float x1, float dx, int* col) const;
+	static float timeOfImpact(int col, float x1, float dx);
 
-	typedef std::vector<ImageAspectWP> SectionVector;
+	typedef std::vector<Path> SectionVector;
 
 	typedef std::vector<int> CommingVector;
 
 private:
-	MainState*      _state;
+	LoaderManager*  _loader;
+	float           _blockSize;
 
-	TextureAspectSP _bgTex[3];
-	float           _bgScroll[3];
-	TextureAspectSP _tilesTex;
+	Box2            _tilesTexCoord;
 	unsigned        _hTiles;
 	unsigned        _vTiles;
-	TextureAspectSP _warningTex;
+	Box2            _warningTexCoord;
 
 	Vector4         _warningColor;
 	Vector4         _pointColor;
 
 	SectionVector   _sections;
+	SectionCache    _sectionCache;
+	std::vector<SectionSP> _pool;
+	Generator       _generator;
+	bool            _endless;
 	unsigned        _nRows;
 
 	int             _length;
-	BlockVector     _blocks;
+	SegmentVector   _segments;
+	ChunkDeque      _chunks;
+	int             _firstChunk;
+	int             _keepCol;
+	MappedFile      _levelFile;
+	RowIndexVector  _rowWalls;
+	RowIndexVector  _rowPoints;
+	// Nearest walls of each row before (or at) and after _warnEdge, the last
+	// column on screen, for the warnings.
+	int              _warnEdge;
+	std::vector<int> _warnPrev;
+	std::vector<int> _warnNext;
+
+	MapTileListener* _tileListener;
 	CommingVector   _comming;
 };
 
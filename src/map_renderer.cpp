@@ -0,0 +1,212 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+
+#include <lair/sys_sdl2/image_loader.h>
+
+#include <lair/ec/sprite_renderer.h>
+
+#include "main_state.h"
+#include "profiler.h"
+
+#include "map_renderer.h"
+
+
+MapRenderer::MapRenderer(MainState* mainState, Map* map)
+	: _state(mainState),
+      _map(map),
+      _bgScroll{ 0, 0, 0 },
+      _tileRenderer(TILES_SPRITES) {
+}
+
+
+void MapRenderer::initialize() {
+	const TextureAtlas& atlas = _state->atlas();
+	Box2 tilesTexCoord;
+	Box2 warningTexCoord;
+	_tilesTex   = atlas.texture("tiles.png",   tilesTexCoord);
+	_warningTex = atlas.texture("warning.png", warningTexCoord);
+	_map->setTexCoords(tilesTexCoord, warningTexCoord);
+
+	Context* glc = _state->renderer()->context();
+	if(!_tileMesh.initialize(glc, _map->rowCount(), Map::CHUNK_SIZE,
+	                         _map->tileTexCoord(Map::WALL), _map->tileTexCoord(Map::POINT)))
+		dbgLogger.warning("Failed to build the tile mesh.");
+	if(!_tileGrid.initialize(glc, _map->rowCount(), Map::CHUNK_SIZE,
+	                         _map->hTiles(), _map->vTiles(), tilesTexCoord))
+		dbgLogger.warning("Failed to build the tile grid.");
+	setTileRenderer(TILES_MESH);
+}
+
+
+void MapRenderer::shutdown() {
+	_map->setTileListener(nullptr);
+	_tileMesh.shutdown();
+	_tileGrid.shutdown();
+}
+
+
+void MapRenderer::setBg(unsigned i, const Path& path) {
+	lairAssert(i < 3);
+	AssetSP bgAsset = _state->loader()->loadAsset<ImageLoader>(path);
+	_bgTex[i] = _state->renderer()->createTexture(bgAsset);
+}
+
+
+void MapRenderer::setBgScroll(unsigned i, float scroll) {
+	lairAssert(i < 3);
+	_bgScroll[i] = scroll;
+}
+
+
+void MapRenderer::setTileRenderer(TileRenderer tr) {
+	if((tr == TILES_MESH && !_tileMesh.isInitialized())
+	|| (tr == TILES_GRID && !_tileGrid.isInitialized()))
+		tr = TILES_SPRITES;
+	if(tr == _tileRenderer)
+		return;
+
+	// Only the active renderer is kept up to date.
+	_tileRenderer = tr;
+	clearTiles();
+	_map->setTileListener((tr == TILES_SPRITES)? nullptr: this);
+}
+
+
+const char* MapRenderer::tileRendererName(TileRenderer tr) {
+	switch(tr) {
+	case TILES_SPRITES: return "sprites";
+	case TILES_MESH:    return "mesh";
+	case TILES_GRID:    return "grid";
+	default:            return "unknown";
+	}
+}
+
+
+void MapRenderer::render(float scroll, float pDist, float screenWidth) {
+	PROFILE_ZONE("MapRenderer::render");
+
+	SpriteRenderer* renderer = _state->spriteRenderer();
+
+	_state->renderer()->uploadPendingTextures();
+
+	Matrix4 trans = _state->screenTransform();
+	Vector4 color(1, 1, 1, 1);
+
+	// Backgrounds
+	for(int i = 0; i < 3; ++i) {
+		if(!_bgTex[i] || !_bgTex[i]->get())
+			continue;
+
+		TextureSP bgTex = _bgTex[i]->_get();
+		float bgScroll = scroll * _bgScroll[i] / bgTex->width();
+		Box2 bgBox(Vector2(0, 0), Vector2(1920, 1080));
+		Box2 bgTexBox(Vector2(bgScroll, 0), Vector2(bgScroll + 1920.f / bgTex->width(), 1));
+		renderer->addSprite(trans, bgBox, color, bgTexBox, bgTex,
+							Texture::TRILINEAR, BLEND_ALPHA);
+	}
+
+	// Warnings
+	_quads.clear();
+	_map->buildWarnings(scroll, pDist, screenWidth, _quads);
+	renderQuads(_warningTex->get());
+
+	// Tiles
+	if(_tileRenderer != TILES_SPRITES)
+		return;
+
+	_quads.clear();
+	_map->buildTiles(scroll, _quads);
+	renderQuads(_tilesTex->_get());
+}
+
+
+void MapRenderer::renderTiles(const Matrix4& viewTransform, float scroll, float screenWidth) {
+	if(_tileRenderer == TILES_SPRITES)
+		return;
+
+	// Tiles are in blocks, relative to the beginning of the map.
+	float blockSize = _map->blockSize();
+	Matrix4 mapTransform = Matrix4::Identity();
+	mapTransform(0, 0) = blockSize;
+	mapTransform(1, 1) = blockSize;
+	mapTransform(0, 3) = -scroll;
+	Matrix4 trans = viewTransform * _state->screenTransform() * mapTransform;
+
+	TextureSP tilesTex = _tilesTex->_get();
+	if(_tileRenderer == TILES_MESH) {
+		int beginCol = _map->blockColumn(_map->beginIndex(scroll / blockSize));
+		int endCol   = _map->blockColumn(_map->endIndex(beginCol));
+		_tileMesh.render(trans, tilesTex, beginCol, endCol);
+	}
+	else {
+		_tileGrid.render(trans, tilesTex, scroll / blockSize,
+		                 (scroll + screenWidth) / blockSize);
+	}
+}
+
+
+void MapRenderer::renderPreview(float scroll, float pDist, float screenWidth, float pWidth) {
+	PROFILE_ZONE("MapRenderer::renderPreview");
+
+	_quads.clear();
+	_map->buildPreview(scroll, pDist, screenWidth, pWidth, _quads);
+	renderQuads(_tilesTex->_get());
+}
+
+
+void MapRenderer::clearTiles() {
+	_tileMesh.clear();
+	_tileGrid.clear();
+}
+
+
+void MapRenderer::pushChunk(int firstCol, const uint32* walls, const uint32* points,
+                            unsigned count) {
+	if(_tileRenderer == TILES_MESH)
+		_tileMesh.pushChunk(firstCol, walls, points, count);
+	else if(_tileRenderer == TILES_GRID)
+		_tileGrid.pushChunk(firstCol, walls, points, count, Map::WALL, Map::POINT);
+}
+
+
+void MapRenderer::popChunk() {
+	_tileMesh.popChunk();
+	_tileGrid.popChunk();
+}
+
+
+void MapRenderer::clearBlock(int col, unsigned row) {
+	_tileMesh.clearBlock(col, row);
+	_tileGrid.clearBlock(col, row);
+}
+
+
+void MapRenderer::renderQuads(TextureSP tex) {
+	SpriteRenderer* renderer = _state->spriteRenderer();
+	Matrix4 trans = _state->screenTransform();
+
+	for(const Map::Quad& quad: _quads) {
+		renderer->addSprite(trans, quad.coords, quad.color, quad.texCoord, tex,
+		                    Texture::BILINEAR, BLEND_ALPHA);
+	}
+}
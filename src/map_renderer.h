@@ -0,0 +1,104 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+
+#ifndef _LD35_MAP_RENDERER_H
+#define _LD35_MAP_RENDERER_H
+
+
+#include <lair/core/lair.h>
+
+#include <lair/render_gl2/texture.h>
+
+#include "tile_mesh.h"
+#include "tile_grid.h"
+
+#include "map.h"
+
+
+using namespace lair;
+
+class MainState;
+
+
+// Draws a Map in the game: backgrounds, warnings, tiles and the preview. It
+// listens to the map to keep the tile renderer buffers up to date, so the
+// map itself does not depend on GL.
+class MapRenderer : public MapTileListener {
+public:
+	// How tiles are drawn.
+	enum TileRenderer {
+		TILES_SPRITES, // A sprite per block, built every frame.
+		TILES_MESH,    // Per-chunk vertex buffers (see TileMesh).
+		TILES_GRID,    // One quad sampling a texture of the map (see TileGrid).
+		TILE_RENDERER_COUNT
+	};
+
+public:
+	MapRenderer(MainState* mainState, Map* map);
+
+	void initialize();
+	void shutdown();
+
+	void setBg(unsigned i, const Path& path);
+	void setBgScroll(unsigned i, float scroll);
+
+	// Falls back to TILES_SPRITES if tr is not available.
+	void setTileRenderer(TileRenderer tr);
+	TileRenderer tileRenderer() const { return _tileRenderer; }
+	static const char* tileRendererName(TileRenderer tr);
+
+	// Draw the backgrounds and the warnings, and the tiles too with
+	// TILES_SPRITES.
+	void render(float scroll, float pDist, float screenWidth);
+	// Draw the tiles with the other renderers, outside of the SpriteRenderer
+	// (so between two of its frames). viewTransform is the transform given to
+	// the SpriteRenderer.
+	void renderTiles(const Matrix4& viewTransform, float scroll, float screenWidth);
+	void renderPreview(float scroll, float pDist, float screenWidth, float pWidth);
+
+	virtual void clearTiles() override;
+	virtual void pushChunk(int firstCol, const uint32* walls, const uint32* points,
+	                       unsigned count) override;
+	virtual void popChunk() override;
+	virtual void clearBlock(int col, unsigned row) override;
+
+private:
+	void renderQuads(TextureSP tex);
+
+private:
+	MainState*      _state;
+	Map*            _map;
+
+	TextureAspectSP _bgTex[3];
+	float           _bgScroll[3];
+	TextureAspectSP _tilesTex;
+	TextureAspectSP _warningTex;
+
+	TileRenderer    _tileRenderer;
+	TileMesh        _tileMesh;
+	TileGrid        _tileGrid;
+	Map::QuadVector _quads;
+};
+
+
+#endif
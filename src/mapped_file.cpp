@@ -0,0 +1,132 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+
+MappedFile::MappedFile()
+	: _data(nullptr),
+	  _size(0)
+#ifdef _WIN32
+	, _file(INVALID_HANDLE_VALUE),
+	  _mapping(nullptr)
+#endif
+{
+}
+
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+
+#ifdef _WIN32
+
+bool MappedFile::open(const Path& path) {
+	close();
+
+	_file = CreateFileA(path.utf8CStr(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+	                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(!_mapping) {
+		close();
+		return false;
+	}
+
+	_data = static_cast<const uint8*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	if(!_data) {
+		close();
+		return false;
+	}
+	_size = size.QuadPart;
+
+	return true;
+}
+
+
+void MappedFile::close() {
+	if(_data)
+		UnmapViewOfFile(_data);
+	if(_mapping)
+		CloseHandle(_mapping);
+	if(_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+
+	_data    = nullptr;
+	_size    = 0;
+	_mapping = nullptr;
+	_file    = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const Path& path) {
+	close();
+
+	int fd = ::open(path.utf8CStr(), O_RDONLY);
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED)
+		return false;
+
+	_data = static_cast<const uint8*>(data);
+	_size = st.st_size;
+
+	return true;
+}
+
+
+void MappedFile::close() {
+	if(_data)
+		munmap(const_cast<uint8*>(_data), _size);
+
+	_data = nullptr;
+	_size = 0;
+}
+
+#endif
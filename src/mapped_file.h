@@ -0,0 +1,60 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _LD35_MAPPED_FILE_H
+#define _LD35_MAPPED_FILE_H
+
+
+#include <lair/core/lair.h>
+
+
+using namespace lair;
+
+
+// A read-only memory mapping of a whole file.
+class MappedFile {
+public:
+	MappedFile();
+	MappedFile(const MappedFile&)  = delete;
+	MappedFile(      MappedFile&&) = delete;
+	~MappedFile();
+
+	MappedFile& operator=(const MappedFile&)  = delete;
+	MappedFile& operator=(      MappedFile&&) = delete;
+
+	bool open(const Path& path);
+	void close();
+
+	bool isOpen() const { return _data; }
+	const uint8* data() const { return _data; }
+	size_t size() const { return _size; }
+
+private:
+	const uint8* _data;
+	size_t       _size;
+#ifdef _WIN32
+	void*        _file;
+	void*        _mapping;
+#endif
+};
+
+
+#endif
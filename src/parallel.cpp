@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+
+unsigned workerCount() {
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+void parallelFor(unsigned count, const std::function<void(unsigned)>& func) {
+	std::atomic<unsigned> next(0);
+	auto worker = [&]() {
+		for(unsigned i = next++; i < count; i = next++) {
+			func(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	unsigned nThreads = std::min(workerCount(), count);
+	for(unsigned i = 1; i < nThreads; ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for(std::thread& thread: threads) {
+		thread.join();
+	}
+}
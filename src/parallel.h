@@ -0,0 +1,38 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _LD35_PARALLEL_H
+#define _LD35_PARALLEL_H
+
+
+#include <functional>
+
+
+// Number of threads used by parallelFor(), at least 1.
+unsigned workerCount();
+
+// Call func(i) for every i in [0, count) on up to workerCount() threads,
+// the calling thread included. Returns once every call is done. Items are
+// handed out one at a time, so uneven items balance themselves.
+void parallelFor(unsigned count, const std::function<void(unsigned)>& func);
+
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "profiler.h"
+
+
+namespace {
+
+struct ProfileEvent {
+	const char* name;
+	int64       begin;
+	int64       end;
+};
+
+// Only its thread writes to a ring. count is the number of events ever
+// written, and is published after each of them, so a reader can tell which
+// of the events it copied may have been overwritten meanwhile.
+struct ProfileRing {
+	unsigned                  tid;
+	std::string               name;
+	std::vector<ProfileEvent> events;
+	std::atomic<uint64>       count;
+};
+
+typedef std::vector<std::unique_ptr<ProfileRing>> RingVector;
+
+std::mutex& ringsMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+RingVector& rings() {
+	static RingVector rings;
+	return rings;
+}
+
+// Rings are never freed, so that the events of the threads that are over
+// can still be written.
+ProfileRing* threadRing() {
+	thread_local ProfileRing* ring = nullptr;
+	if(!ring) {
+		std::lock_guard<std::mutex> lock(ringsMutex());
+		rings().emplace_back(new ProfileRing);
+		ring = rings().back().get();
+		ring->tid = rings().size();
+		ring->name = "thread " + std::to_string(ring->tid);
+		ring->events.resize(Profiler::RING_SIZE);
+		ring->count = 0;
+	}
+	return ring;
+}
+
+void writeJsonString(FILE* out, const char* str) {
+	fputc('"', out);
+	for(; *str; ++str) {
+		if(*str == '"' || *str == '\\')
+			fputc('\\', out);
+		if(uint8(*str) >= 0x20)
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+}
+
+
+bool Profiler::isEnabled() {
+#ifdef SHAPEOUT_PROFILER
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+int64 Profiler::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Profiler::setThreadName(const char* name) {
+	if(!isEnabled())
+		return;
+
+	ProfileRing* ring = threadRing();
+	std::lock_guard<std::mutex> lock(ringsMutex());
+	ring->name = name;
+}
+
+
+void Profiler::record(const char* name, int64 begin, int64 end) {
+	ProfileRing* ring = threadRing();
+	uint64 count = ring->count.load(std::memory_order_relaxed);
+	ProfileEvent& event = ring->events[count % RING_SIZE];
+	event.name  = name;
+	event.begin = begin;
+	event.end   = end;
+	ring->count.store(count + 1, std::memory_order_release);
+}
+
+
+bool Profiler::writeChromeTrace(const Path& path, Logger& log) {
+	if(!isEnabled()) {
+		log.warning("The profiler is not compiled in (see SHAPEOUT_PROFILER).");
+		return false;
+	}
+
+	FILE* out = fopen(path.utf8CStr(), "w");
+	if(!out) {
+		log.error("Failed to open \"", path, "\".");
+		return false;
+	}
+
+	// Copy the events first, as the threads go on.
+	std::lock_guard<std::mutex> lock(ringsMutex());
+	std::vector<std::vector<ProfileEvent>> events(rings().size());
+	int64 origin = std::numeric_limits<int64>::max();
+	for(unsigned ri = 0; ri < rings().size(); ++ri) {
+		const ProfileRing& ring = *rings()[ri];
+		uint64 end   = ring.count.load(std::memory_order_acquire);
+		uint64 begin = end - std::min<uint64>(end, RING_SIZE);
+		for(uint64 i = begin; i < end; ++i)
+			events[ri].push_back(ring.events[i % RING_SIZE]);
+
+		// Drop the events the thread may have overwritten while we copied:
+		// writing event i overwrites event i - RING_SIZE.
+		uint64 written = ring.count.load(std::memory_order_acquire) + 1;
+		if(written > begin + RING_SIZE) {
+			uint64 skip = std::min<uint64>(written - RING_SIZE - begin, events[ri].size());
+			events[ri].erase(events[ri].begin(), events[ri].begin() + skip);
+		}
+
+		if(!events[ri].empty())
+			origin = std::min(origin, events[ri].front().begin);
+	}
+
+	// Timestamps are in microseconds, relative to the first event.
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	unsigned nEvents = 0;
+	for(unsigned ri = 0; ri < rings().size(); ++ri) {
+		const ProfileRing& ring = *rings()[ri];
+		fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+		             "\"args\":{\"name\":", ri? ",\n": "", ring.tid);
+		writeJsonString(out, ring.name.c_str());
+		fprintf(out, "}}");
+
+		for(const ProfileEvent& event: events[ri]) {
+			fprintf(out, ",\n{\"name\":");
+			writeJsonString(out, event.name);
+			fprintf(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			        ring.tid, (event.begin - origin) / 1000.0,
+			        (event.end - event.begin) / 1000.0);
+			++nEvents;
+		}
+	}
+	fprintf(out, "\n]}\n");
+
+	bool ok = !ferror(out);
+	fclose(out);
+	if(!ok) {
+		log.error("Failed to write \"", path, "\".");
+		return false;
+	}
+
+	log.info("Wrote ", nEvents, " profile zones to \"", path, "\".");
+	return true;
+}
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef _LD35_PROFILER_H
+#define _LD35_PROFILER_H
+
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+
+
+using namespace lair;
+
+
+// A scoped-zone profiler. PROFILE_ZONE("name") records the time spent from
+// there to the end of the scope, in a ring buffer of the calling thread that
+// keeps the last RING_SIZE zones. Zones are only compiled in if
+// SHAPEOUT_PROFILER is defined (see the CMake option of the same name);
+// otherwise they cost nothing. Names must be string literals.
+class Profiler {
+public:
+	enum {
+		RING_SIZE = 1 << 16,
+	};
+
+	static bool isEnabled();
+	static int64 now();
+
+	static void setThreadName(const char* name);
+	static void record(const char* name, int64 begin, int64 end);
+
+	// Write the zones of every thread as Chrome trace event JSON, which
+	// chrome://tracing and Perfetto open.
+	static bool writeChromeTrace(const Path& path, Logger& log);
+};
+
+
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name)
+	    : _name(name), _begin(Profiler::now()) {
+	}
+	ProfileZone(const ProfileZone&) = delete;
+	~ProfileZone() {
+		Profiler::record(_name, _begin, Profiler::now());
+	}
+
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* _name;
+	int64       _begin;
+};
+
+
+#ifdef SHAPEOUT_PROFILER
+#define _PROFILE_CONCAT2(a, b) a ## b
+#define _PROFILE_CONCAT(a, b) _PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfileZone _PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+
+#endif
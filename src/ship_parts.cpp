@@ -0,0 +1,162 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "ship_parts.h"
+
+
+ShipDef::ShipDef()
+	: _shapeCount(1) {
+}
+
+
+bool ShipDef::load(const Json::Value& json, float blockSize, Logger& log) {
+	clear();
+
+	try {
+		const Json::Value& parts = json["parts"];
+		const Json::Value& shapes = json["shapes"];
+		if(!parts.isArray() || !shapes.isArray() || shapes.size() == 0) {
+			log.error("Ship: expected arrays of parts and of shapes");
+			return false;
+		}
+
+		std::vector<ShipPartDef> partDefs;
+		for(const Json::Value& p: parts) {
+			ShipPartDef def;
+			def.tile       = p.get("tile", 0).asInt();
+			def.baseTile   = p.get("base_tile", 0).asInt();
+			def.beamAnchor = Vector2(p["beam"].get(0u, .25).asFloat(),
+			                         p["beam"].get(1u, .25).asFloat());
+			def.beamSource = p.get("beam_source", 0).asUInt();
+			partDefs.push_back(def);
+		}
+
+		unsigned count = partDefs.size();
+		std::vector<float> shapeX;
+		std::vector<float> shapeY;
+		shapeX.reserve(shapes.size() * count);
+		shapeY.reserve(shapes.size() * count);
+		for(unsigned si = 0; si < shapes.size(); ++si) {
+			const Json::Value& shape = shapes[si];
+			if(shape.size() != count) {
+				log.error("Ship: shape ", si, " has ", shape.size(),
+				          " parts, expected ", count);
+				return false;
+			}
+			for(const Json::Value& pos: shape) {
+				float x = pos[0].asFloat();
+				float y = pos[1].asFloat();
+				if(x < MIN_PART_X || y < MIN_PART_Y || y > MAX_PART_Y) {
+					log.error("Ship: shape ", si, " has a part at (", x, ", ", y,
+					          "), out of [", int(MIN_PART_X), ", +inf) x [",
+					          int(MIN_PART_Y), ", ", int(MAX_PART_Y), "]");
+					return false;
+				}
+				shapeX.push_back(x * blockSize);
+				shapeY.push_back(y * blockSize);
+			}
+		}
+
+		_parts.swap(partDefs);
+		_shapeCount = shapes.size();
+		_shapeX.swap(shapeX);
+		_shapeY.swap(shapeY);
+	}
+	catch(Json::LogicError e) {
+		log.error("Ship: ", e.what());
+		return false;
+	}
+
+	return true;
+}
+
+
+void ShipDef::clear() {
+	_parts.clear();
+	_shapeCount = 1;
+	_shapeX.clear();
+	_shapeY.clear();
+}
+
+
+void ShipParts::reset(const ShipDef& def, unsigned shape) {
+	unsigned count = def.partCount();
+	x.assign(def.shapeX(shape), def.shapeX(shape) + count);
+	y.assign(def.shapeY(shape), def.shapeY(shape) + count);
+	vx.assign(count, 0);
+	vy.assign(count, 0);
+	alive.assign(count, 1);
+}
+
+
+void ShipParts::gather(const float* tx, const float* ty, float maxSpeed) {
+	unsigned count = size();
+	const float* px = x.data();
+	const float* py = y.data();
+	float* pvx = vx.data();
+	float* pvy = vy.data();
+
+	// Dead parts get a move too, that shift() ignores: no branch on alive.
+	// A part in place gets an infinite scale, clamped to 1.
+	for(unsigned i = 0; i < count; ++i) {
+		float gx = tx[i] - px[i];
+		float gy = ty[i] - py[i];
+		float scale = std::min(1.f, maxSpeed / std::sqrt(gx * gx + gy * gy));
+		pvx[i] = gx * scale;
+		pvy[i] = gy * scale;
+	}
+}
+
+
+float ShipParts::shift() {
+	unsigned count = size();
+	float* px = x.data();
+	float* py = y.data();
+	const float* pvx = vx.data();
+	const float* pvy = vy.data();
+	const float* pa  = alive.data();
+
+	for(unsigned i = 0; i < count; ++i) {
+		px[i] += pvx[i] * pa[i];
+		py[i] += pvy[i] * pa[i];
+	}
+
+	// A float sum is not reordered by the compiler, so it gets its own loop
+	// to keep the one above vectorized.
+	float drag = 0;
+	for(unsigned i = 0; i < count; ++i)
+		drag += pvy[i] * pa[i];
+	return drag;
+}
+
+
+void ShipParts::drop(float speed, float bottom) {
+	unsigned count = size();
+	float* py = y.data();
+	const float* pa = alive.data();
+
+	for(unsigned i = 0; i < count; ++i)
+		py[i] -= speed * float((pa[i] == 0) & (py[i] > bottom));
+}
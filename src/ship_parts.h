@@ -0,0 +1,112 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_SHIP_PARTS_H
+#define _LD35_SHIP_PARTS_H
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+#include <lair/core/json.h>
+
+
+using namespace lair;
+
+
+struct ShipPartDef {
+	int      tile;       // Tile of the part sprite.
+	int      baseTile;   // Tile of the sprite drawn under it.
+	Vector2  beamAnchor; // Where the beam hits the part, in blocks.
+	unsigned beamSource; // Block of the ship the beam comes from.
+};
+
+
+// The parts of a ship and the shapes it can take, loaded from json:
+//
+//     { "parts":  [ { "tile": 9, "base_tile": 0, "beam": [ 0.25, 0.25 ],
+//                     "beam_source": 0 }, ... ],
+//       "shapes": [ [ [ 0, 1 ], ... ], ... ] }
+//
+// A shape is the place of every part relative to the ship, in blocks.
+class ShipDef {
+public:
+	// Bounds of the place of the parts, in blocks. From where Simulation
+	// starts the ship, they keep every part on the screen and in the 22 rows
+	// of the map.
+	enum {
+		MIN_PART_X = -4,
+		MIN_PART_Y = -11,
+		MAX_PART_Y = 10,
+	};
+
+public:
+	ShipDef();
+
+	// On failure, the ship has no part and a single (empty) shape.
+	bool load(const Json::Value& json, float blockSize, Logger& log);
+
+	unsigned partCount()  const { return _parts.size(); }
+	unsigned shapeCount() const { return _shapeCount; }
+	const ShipPartDef& part(unsigned part) const { return _parts[part]; }
+
+	// Place of the parts in shape, in pixels, one array per coordinate.
+	const float* shapeX(unsigned shape) const { return _shapeX.data() + shape * partCount(); }
+	const float* shapeY(unsigned shape) const { return _shapeY.data() + shape * partCount(); }
+
+private:
+	void clear();
+
+private:
+	std::vector<ShipPartDef> _parts;
+	unsigned                 _shapeCount;
+	std::vector<float>       _shapeX;
+	std::vector<float>       _shapeY;
+};
+
+
+// State of the ship parts, as structure of arrays: the part physics are
+// straight loops over contiguous floats, that the compiler vectorizes.
+struct ShipParts {
+	unsigned size() const { return x.size(); }
+
+	// Put all the parts alive at their place in shape.
+	void reset(const ShipDef& def, unsigned shape);
+
+	// Set the move of every part toward its place (tx, ty), capped to
+	// maxSpeed.
+	void gather(const float* tx, const float* ty, float maxSpeed);
+	// Move the live parts and return the sum of their vertical moves.
+	float shift();
+	// Move the dead parts down by speed until they are below bottom.
+	void drop(float speed, float bottom);
+
+	std::vector<float> x;     // Position relative to the ship.
+	std::vector<float> y;
+	std::vector<float> vx;    // Move of the current tick.
+	std::vector<float> vy;
+	std::vector<float> alive; // 1 if the part is alive, 0 otherwise.
+};
+
+
+#endif
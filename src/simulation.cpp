@@ -0,0 +1,589 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "profiler.h"
+#include "simulation.h"
+
+
+#ifdef SHAPEOUT_DETERMINISTIC
+#ifdef __FAST_MATH__
+#error "SHAPEOUT_DETERMINISTIC is not compatible with -ffast-math"
+#endif
+#if FLT_EVAL_METHOD != 0
+#error "SHAPEOUT_DETERMINISTIC needs SSE floats (-msse2 -mfpmath=sse on x86)"
+#endif
+#endif
+
+
+namespace {
+
+// std::pow() gives the results of the libm, which differ from one to the
+// other by an ulp or so, and compilers fold constant calls with their own.
+// This one only uses basic operations, for x > 0. It is slow, but only
+// computes the physics constants.
+double physicsPow(double x, double y) {
+#ifdef SHAPEOUT_DETERMINISTIC
+	const double ln2 = 0.69314718055994530942;
+
+	// log(x) = e log(2) + 2 atanh((m - 1) / (m + 1)), with m in
+	// [sqrt(.5), sqrt(2)).
+	int e;
+	double m = std::frexp(x, &e);
+	if(m < 0.70710678118654752440) {
+		m *= 2;
+		--e;
+	}
+	double t  = (m - 1) / (m + 1);
+	double t2 = t * t;
+	double atanh = 0;
+	double term  = t;
+	for(int k = 0; k < 20; ++k) {
+		atanh += term / (2 * k + 1);
+		term  *= t2;
+	}
+	double z = y * (e * ln2 + 2 * atanh);
+
+	// exp(z) = 2^n exp(r), with |r| <= log(2) / 2.
+	double n = std::floor(z / ln2 + .5);
+	double r = z - n * ln2;
+	double exp = 1;
+	term = 1;
+	for(int k = 1; k < 25; ++k) {
+		term *= r / k;
+		exp  += term;
+	}
+	return std::ldexp(exp, int(n));
+#else
+	return std::pow(x, y);
+#endif
+}
+
+uint64 hashBytes(const void* data, size_t size, uint64 hash) {
+	// FNV-1a
+	const uint8* bytes = static_cast<const uint8*>(data);
+	for(size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+template<typename T>
+uint64 hashValue(const T& value, uint64 hash) {
+	return hashBytes(&value, sizeof(T), hash);
+}
+
+uint64 hashFloats(const std::vector<float>& values, uint64 hash) {
+	return hashBytes(values.data(), values.size() * sizeof(float), hash);
+}
+
+}
+
+
+// Fields are hashed one by one, as SimState has padding.
+uint64 hashSimState(const SimState& state, uint64 hash) {
+	hash = hashValue(state.ticks,         hash);
+	hash = hashValue(state.prevScrollPos, hash);
+	hash = hashValue(state.scrollPos,     hash);
+	hash = hashValue(state.distance,      hash);
+	hash = hashValue(state.score,         hash);
+	hash = hashValue(state.shipPos(0),    hash);
+	hash = hashValue(state.shipPos(1),    hash);
+	hash = hashValue(state.shipHSpeed,    hash);
+	hash = hashValue(state.shipVSpeed,    hash);
+	hash = hashValue(state.climbCharge,   hash);
+	hash = hashValue(state.diveCharge,    hash);
+	hash = hashValue(state.shipShape,     hash);
+	hash = hashFloats(state.parts.x,      hash);
+	hash = hashFloats(state.parts.y,      hash);
+	hash = hashFloats(state.parts.vx,     hash);
+	hash = hashFloats(state.parts.vy,     hash);
+	hash = hashFloats(state.parts.alive,  hash);
+	hash = hashValue(state.deathTimer,    hash);
+	hash = hashValue(state.warningTileX,  hash);
+	hash = hashValue(state.warningRows,   hash);
+	return hash;
+}
+
+
+Simulation::Simulation(Map* map, float blockSize)
+    : _map(map),
+      _shipDef(),
+      _state(),
+
+      _tickDuration(ONE_SEC / 60),
+      _screenWidth (SCREEN_WIDTH),
+
+      _partFirstRow(0),
+      _partEndRow  (0),
+
+      _blockSize    (blockSize),
+
+/* Physics are in pixels and seconds, so the game plays the same at any tick
+ * rate. Values were tuned at 60 ticks per second, hence the 60s below.
+ * Braking keeps 99% of the speed every 1/60th of a second.
+ */
+      _hSpeedDamping(500),
+      _acceleration (400 * 60),
+      _minShipHSpeed(1000),
+      _brakingFactor(physicsPow(0.99, 60)),
+
+/* One full-charge tap up or down will instantly reach 1/8 of a block per
+ * 1/60th of a second.
+ * - This is about enough for a "human" tap at 60FPS to move one block away.
+ * Tap power is restored over half a second.
+ * Thrust is the base climb/dive power ; worth one tap every 1/6th second.
+ */
+      _thrustMaxCharge  (_blockSize / 8 * 60),
+      _thrustRateCharge (2 * _thrustMaxCharge),
+      _thrustPower      (_thrustMaxCharge * 6),
+
+/* Damping is the part of the vertical speed left after a second ; about
+ * .5~.9 every 1/60th of a second.
+ * - Below .5, one tap does not reach one block ; above .8 it may jump two.
+ * Below min speed (0.2 block/s), the ship halts and snaps to grid.
+ * The ship should never go above max speed (0.5 block/60th) for safety reasons.
+ * When left adrift, the ship will line in, covering 10% of the gap every
+ * 1/60th of a second (lock factor is the part of the gap left after a second).
+ */
+      _vSpeedDamping (physicsPow(0.8, 60)),
+      _vSpeedFloor   (0.2 * _blockSize),
+      _vSpeedCap     (_blockSize / 2 * 60),
+      _vLockFactor   (physicsPow(0.9, 60)),
+
+/* Collisions above scratch threshold will bump the player.
+ * Collisions above crash threshold will kill the player.
+ * When bumping against a wall, the player will be ejected within 2/60th of a
+ * second.
+ */
+      _scratchThreshold (_blockSize / 4),
+      _crashThreshold   (_blockSize / 2),
+      _bumpawayTime     (2.0 / 60),
+
+/* Parts move at a top rate of 1/4 block per 1/60th of a second.
+ * Destroyed parts are bumped up then fall offscreen at 1/3 block per 60th.
+ * Parts are lost when going further away (by 1 block) than the farthest part.
+ * The mass ratio reduces the drag feedback from the parts: it is the vertical
+ * speed the ship gets per pixel moved by the parts.
+ */
+      _partBaseSpeed (_blockSize / 4 * 60),
+      _partDropSpeed (_blockSize / 3 * 60),
+      _snapDistance  (_blockSize * (6+1)),
+      _massRatio     (60.0/16),
+
+      _tickBraking   (1),
+      _tickVDamping  (1),
+      _tickVLock     (0)
+{
+	setTickDuration(_tickDuration);
+	start(_shipDef);
+}
+
+
+void Simulation::setTickDuration(int64 tickDuration) {
+	_tickDuration = tickDuration;
+
+	float dt = float(_tickDuration) / float(ONE_SEC);
+	_tickBraking  = physicsPow(_brakingFactor, dt);
+	_tickVDamping = physicsPow(_vSpeedDamping, dt);
+	_tickVLock    = 1 - physicsPow(_vLockFactor, dt);
+}
+
+
+void Simulation::setScreenWidth(float screenWidth) {
+	_screenWidth = screenWidth;
+}
+
+
+void Simulation::start(const ShipDef& shipDef) {
+	_shipDef = shipDef;
+
+	SimState& s = _state;
+	s.ticks         = 0;
+	s.scrollPos     = 0;
+	s.prevScrollPos = s.scrollPos;
+	s.distance      = 0;
+	s.score         = 0;
+
+	s.shipPos     = Vector2(4*_blockSize, 11*_blockSize);
+	s.shipHSpeed  = 2*_minShipHSpeed;
+	s.shipVSpeed  = 0;
+	s.climbCharge = _thrustMaxCharge;
+	s.diveCharge  = _thrustMaxCharge;
+
+	s.shipShape = 0;
+	s.parts.reset(_shipDef, s.shipShape);
+
+	s.deathTimer   = -1;
+	s.warningTileX = 0;
+	s.warningRows  = 0;
+}
+
+
+void Simulation::tickDeathTimer() {
+	if(!_state.isAlive())
+		_state.deathTimer += _tickDuration;
+}
+
+
+unsigned Simulation::tick(const SimInput& input) {
+	SimState& s = _state;
+	unsigned partCount = _shipDef.partCount();
+	unsigned events = 0;
+
+	bool alive = s.isAlive();
+
+	double tickDur = double(_tickDuration) / double(ONE_SEC);
+
+	// Shapeshift !
+	if(alive && input.justPressed(SimInput::STRETCH)) { ++s.shipShape; }
+	if(alive && input.justPressed(SimInput::SHRINK))  { --s.shipShape; }
+	s.shipShape = std::max(0, std::min(int(_shipDef.shapeCount()) - 1, int(s.shipShape)));
+
+	// Horizontal control and physics.
+	if (alive && input.isPressed(SimInput::ACCEL)) {
+		float damping = (1 + s.shipHSpeed / _hSpeedDamping);
+		s.shipHSpeed += _acceleration * tickDur / (damping * damping);
+	}
+	if (alive && input.isPressed(SimInput::BRAKE))
+		s.shipHSpeed = std::max(s.shipHSpeed * _tickBraking, _minShipHSpeed);
+
+	s.shipHSpeed = std::max(s.shipHSpeed, 0.f);
+	s.scrollPos += s.shipHSpeed * tickDur;
+	s.distance  += s.shipHSpeed * tickDur;
+
+	streamMap();
+
+	// Gathering parts
+	float magDrag = 0;
+	const float* shapeY = _shipDef.shapeY(s.shipShape);
+	s.parts.gather(_shipDef.shapeX(s.shipShape), shapeY, _partBaseSpeed * tickDur);
+	for (unsigned i = 0 ; i < partCount ; ++i)
+		if (s.parts.alive[i] && shapeY[i] - s.parts.y[i] > _snapDistance)
+		{
+			destroyPart(i);
+			events |= SIM_PART_LOST;
+		}
+
+	// Vertical speed control and physics.
+	float& vspeed = s.shipVSpeed;
+
+	// Recharging thrusters.
+	float charge = _thrustRateCharge * tickDur;
+	s.climbCharge = std::min(s.climbCharge + charge, _thrustMaxCharge);
+	s.diveCharge  = std::min(s.diveCharge  + charge, _thrustMaxCharge);
+
+	// Activating thrusters.
+	bool climb = input.isPressed(SimInput::CLIMB);
+	bool dive  = input.isPressed(SimInput::DIVE);
+	if (alive && input.justPressed(SimInput::CLIMB)) {
+		vspeed += s.climbCharge;
+		s.climbCharge = 0;
+	}
+	if (alive && input.justPressed(SimInput::DIVE)) {
+		vspeed -= s.diveCharge;
+		s.diveCharge = 0;
+	}
+	if (alive && climb) { vspeed += _thrustPower * tickDur; }
+	if (alive && dive)  { vspeed -= _thrustPower * tickDur; }
+
+	// Automatic vertical slowdown.
+	if ( alive && !(climb || dive) )
+		vspeed *= _tickVDamping;
+
+	if(alive) {
+		// Bouncing (or crashing) on walls.
+		updatePartBoxes();
+		collide();
+
+		float bump = _partBumps[partCount];
+		if (bump == INFINITY) {
+			s.deathTimer = 0;
+			events |= SIM_CRASH;
+		}
+		else if (bump != 0)
+			vspeed = bump;
+
+		for (unsigned i = 0 ; i < partCount ; ++i)
+		{
+			if (!s.parts.alive[i]) { continue; }
+
+			bump = _partBumps[i];
+			if (bump == INFINITY)
+			{
+				destroyPart(i);
+				events |= SIM_PART_LOST;
+			}
+			else if (bump != 0)
+				s.parts.vy[i] = bump * tickDur;
+		}
+
+		// Looting
+		collect();
+		unsigned points = 0;
+		for (unsigned pickups: _partPickups)
+			points += pickups;
+		s.score += points * ((s.shipHSpeed / 1000) - 1);
+		if (points)
+			events |= SIM_POINTS;
+
+		// Shifting parts.
+		magDrag = s.parts.shift();
+	}
+
+	// Killin' parts !
+	s.parts.drop(_partDropSpeed * tickDur, -SCREEN_HEIGHT);
+
+	// In Soviet Russia, parts gather you !
+	vspeed += -magDrag * _massRatio;
+
+	// Clamping vertical speed.
+	if (std::abs(vspeed) > _vSpeedCap)
+		vspeed = std::min(std::max(vspeed, -_vSpeedCap), _vSpeedCap);
+
+
+	// Shifting ship.
+	if (alive)
+		s.shipPos[1] += vspeed * tickDur;
+	else
+		s.shipPos[1] -= _partDropSpeed * tickDur;
+
+	if(alive) {
+		// Halting ship and snapping to grid .
+		if (std::abs(vspeed) < _vSpeedFloor)
+			s.shipPos[1] -= _tickVLock *
+			  (std::fmod(s.shipPos[1] + _blockSize/2,_blockSize) - _blockSize/2);
+	}
+
+	// Warning sound
+	int warningTileX = (s.scrollPos + SCREEN_WIDTH + warningScrollDist()) / _blockSize;
+	int warningTileBegin = _map->beginIndex(std::max(0, s.warningTileX-1));
+	int warningTileEnd   = _map->beginIndex(warningTileX);
+	for(int y = 1; y < 21; ++y) {
+		bool hasWall = _map->hasWallAtYInRange(y, warningTileBegin, warningTileEnd);
+		if(hasWall && !(s.warningRows & (1u << y)))
+			events |= SIM_WARNING;
+		if(hasWall)
+			s.warningRows |= 1u << y;
+		else
+			s.warningRows &= ~(1u << y);
+	}
+	s.warningTileX = std::max(warningTileX, s.warningTileX);
+
+	s.prevScrollPos = s.scrollPos;
+	++s.ticks;
+
+	return events;
+}
+
+
+bool Simulation::isFinished() const {
+	return !_map->isEndless()
+	    && _state.scrollPos >= _map->length() * _blockSize;
+}
+
+
+// Materialize the map from the left of the screen or of the ship, whichever
+// is first, to the end of the warning lookahead, and evict the rest. The
+// collision tests sweep the parts from where they were at the previous tick.
+void Simulation::streamMap() {
+	int beginCol = streamBeginColumn(_state);
+	int endCol   = (_state.scrollPos + _screenWidth + warningScrollDist()) / _blockSize + 1;
+	_map->stream(beginCol, endCol);
+}
+
+
+int Simulation::streamBeginColumn(const SimState& state) const {
+	float left = std::min(0.f, state.shipPos(0));
+	for (unsigned i = 0 ; i < state.parts.size() ; ++i)
+	{
+		if (state.parts.alive[i])
+			left = std::min(left, state.shipPos(0) + state.parts.x[i]);
+	}
+	return std::floor((state.prevScrollPos + left) / _blockSize);
+}
+
+
+Box2 Simulation::partBox (unsigned part) const
+{
+	Vector2 partCorner = _state.shipPos,
+	        partSize   = Vector2(_blockSize,_blockSize); // Buh.
+	if (part < _shipDef.partCount())
+	{
+		partCorner += Vector2(_state.parts.x[part], _state.parts.y[part]);
+		partSize += Vector2(2 * _blockSize,0); // Ick !
+	}
+
+	partCorner += Vector2(_state.scrollPos,0);
+
+	return Box2(partCorner, partCorner + partSize);
+}
+
+
+// Compute the boxes of the ship and its parts once for all the collision
+// tests of the tick.
+void Simulation::updatePartBoxes()
+{
+	unsigned partCount = _shipDef.partCount();
+
+	Box2 bounds;
+	_partBoxes.resize(partCount + 1);
+	for (unsigned i = 0 ; i <= partCount ; ++i)
+	{
+		_partBoxes[i] = partBox(i);
+		bounds.extend(_partBoxes[i]);
+	}
+
+	_partFirstRow = std::max(0.f, std::floor(bounds.min()[1] / _blockSize));
+	_partEndRow   = std::max(0.f, std::min(float(_map->rowCount()),
+	                                       std::ceil(bounds.max()[1] / _blockSize)));
+}
+
+
+// Fill the swept boxes with the live parts (and the ship) that overlap row by
+// more than minAmount. Parts are swept from where they were at the previous
+// tick, so they can not go through blocks however fast they go.
+void Simulation::sweptRow (unsigned row, float minAmount)
+{
+	unsigned partCount = _shipDef.partCount();
+	float dScroll = _state.scrollPos - _state.prevScrollPos;
+
+	_sweptBoxes.clear();
+	_sweptParts.clear();
+	for (unsigned part = 0 ; part <= partCount ; ++part)
+	{
+		if (part < partCount && !_state.parts.alive[part]) { continue; }
+
+		const Box2& pBox = _partBoxes[part];
+		float amount = std::min(pBox.max()[1], (row + 1) * _blockSize)
+		             - std::max(pBox.min()[1], row * _blockSize);
+		if (amount <= minAmount) { continue; }
+
+		// Like the block scan this replaces, test the columns up to the one
+		// right of the column under the left of the part, and not the whole
+		// 3-block box. It ends half a column further so that the integer
+		// columns compare exactly with it.
+		float lastCol = std::floor(pBox.min()[0] / _blockSize) + 1;
+		Map::SweptBox box = { (pBox.min()[0] - dScroll) / _blockSize,
+		                      lastCol + .5f - dScroll / _blockSize,
+		                      INFINITY };
+		_sweptBoxes.push_back(box);
+		_sweptParts.push_back(part);
+	}
+}
+
+
+// Check the ship and all its live parts for collision at once, and set their
+// vertical bump speed in _partBumps. If the bump is INFINITY, the part has
+// crashed. The bump comes from the first wall a part hits.
+void Simulation::collide ()
+{
+	PROFILE_ZONE("Simulation::collide");
+
+	unsigned partCount = _shipDef.partCount();
+	float dx = (_state.scrollPos - _state.prevScrollPos) / _blockSize;
+
+	_partBumps.assign(partCount + 1, 0);
+	_partTois .assign(partCount + 1, INFINITY);
+
+	for (unsigned row = _partFirstRow ; row < _partEndRow ; row++)
+	{
+		sweptRow(row, 0);
+		_map->sweepWalls(row, dx, _sweptBoxes.data(), _sweptBoxes.size());
+
+		for (unsigned i = 0 ; i < _sweptBoxes.size() ; i++)
+		{
+			unsigned part = _sweptParts[i];
+			float    toi  = _sweptBoxes[i].toi;
+			if (toi == INFINITY || _partBumps[part] == INFINITY)
+				continue;
+
+			const Box2& pBox = _partBoxes[part];
+			float amount = std::min(pBox.max()[1], (row + 1) * _blockSize)
+			             - std::max(pBox.min()[1], row * _blockSize);
+
+			if (amount > _crashThreshold)
+				_partBumps[part] = INFINITY;
+			else if (amount > _scratchThreshold && toi < _partTois[part])
+			{
+				_partTois[part] = toi;
+				if (row * _blockSize > pBox.min()[1])
+					_partBumps[part] = -amount / _bumpawayTime;
+				else
+					_partBumps[part] = amount / _bumpawayTime;
+			}
+		}
+	}
+}
+
+
+// Pick up the points in the way of the ship and its live parts, and set the
+// number of points each of them picked up in _partPickups.
+void Simulation::collect ()
+{
+	PROFILE_ZONE("Simulation::collect");
+
+	float dx = (_state.scrollPos - _state.prevScrollPos) / _blockSize;
+
+	_partPickups.assign(_shipDef.partCount() + 1, 0);
+
+	for (unsigned row = _partFirstRow ; row < _partEndRow ; row++)
+	{
+		sweptRow(row, _crashThreshold);
+		if (_sweptBoxes.empty()) { continue; }
+
+		float x0 = _sweptBoxes[0].x0,
+		      x1 = _sweptBoxes[0].x1;
+		for (const Map::SweptBox& box: _sweptBoxes)
+		{
+			x0 = std::min(x0, box.x0);
+			x1 = std::max(x1, box.x1);
+		}
+
+		_map->pointsInRow(row, std::floor(x0), std::ceil(x1 + dx), _sweptPoints);
+		for (int col: _sweptPoints)
+		{
+			for (unsigned i = 0 ; i < _sweptBoxes.size() ; i++)
+			{
+				const Map::SweptBox& box = _sweptBoxes[i];
+				if (col >= int(std::floor(box.x0)) && col < box.x1 + dx)
+				{
+					_map->clearBlock(_map->beginIndex(col) + row);
+					++_partPickups[_sweptParts[i]];
+					break;
+				}
+			}
+		}
+	}
+}
+
+
+void Simulation::destroyPart (unsigned part)
+{
+	lairAssert (part < _shipDef.partCount());
+	lairAssert (_state.parts.alive[part]);
+
+	_state.parts.alive[part] = 0;
+	_state.parts.y[part] += _blockSize;
+}
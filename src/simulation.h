@@ -0,0 +1,212 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_SIMULATION_H
+#define _LD35_SIMULATION_H
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+
+#include "ship_parts.h"
+#include "map.h"
+
+
+#define ONE_SEC (1000000000)
+
+#define MIN_TICK_RATE 30
+#define MAX_TICK_RATE 1000
+
+#define SIM_HASH_SEED 14695981039346656037ull
+
+//FIXME?
+#define SCREEN_WIDTH  1920
+#define SCREEN_HEIGHT 1080
+
+
+using namespace lair;
+
+
+// The controls of the ship for a tick, one bit per button.
+struct SimInput {
+	enum Button {
+		ACCEL   = 1 << 0,
+		BRAKE   = 1 << 1,
+		CLIMB   = 1 << 2,
+		DIVE    = 1 << 3,
+		STRETCH = 1 << 4,
+		SHRINK  = 1 << 5,
+	};
+
+	bool isPressed  (Button button) const { return buttons & button; }
+	bool justPressed(Button button) const { return pressed & button; }
+
+	uint8 buttons; // Buttons held down.
+	uint8 pressed; // Buttons pressed since the previous tick.
+};
+
+
+// What happened during a tick, returned by Simulation::tick().
+enum SimEvent {
+	SIM_CRASH     = 1 << 0, // The ship crashed.
+	SIM_PART_LOST = 1 << 1, // At least one part crashed or got lost.
+	SIM_POINTS    = 1 << 2, // Points were picked up.
+	SIM_WARNING   = 1 << 3, // A wall came in sight in a row.
+};
+
+
+// Everything a simulation changes from tick to tick, as plain data. Positions
+// are in pixels; the ship is relative to the screen, the parts to the ship.
+struct SimState {
+	bool isAlive() const { return deathTimer < 0; }
+
+	unsigned  ticks;          // Since start().
+	float     prevScrollPos;
+	float     scrollPos;
+	float     distance;
+	float     score;
+	Vector2   shipPos;
+	float     shipHSpeed;     // Pixels per second.
+	float     shipVSpeed;
+	float     climbCharge;
+	float     diveCharge;
+	unsigned  shipShape;
+	ShipParts parts;
+	int64     deathTimer;     // Time since the crash, -1 while alive.
+	int       warningTileX;
+	uint32    warningRows;    // Rows with a wall in sight, one bit per row.
+};
+
+// Hash the bits of state into hash. Chained over the ticks of a run, it tells
+// whether two runs went exactly the same way, e.g. a replay and its
+// recording.
+uint64 hashSimState(const SimState& state, uint64 hash = SIM_HASH_SEED);
+
+
+// The game physics: the ship and its parts flying through a Map, driven by
+// SimInput. It does not draw or play anything, so it can run without a
+// window (see tools/simulate.cpp).
+//
+// The physics only use IEEE 754 operations, that round the same on every
+// platform, but compilers may still fuse a multiply and an add, or keep
+// floats in wider registers, depending on the target and optimization level.
+// Builds with SHAPEOUT_DETERMINISTIC forbid both, and compute the physics
+// constants without the libm (sqrt, fmod and floor are exact anyway), so
+// that the same inputs give bit-identical states whatever the compiler.
+class Simulation {
+public:
+	Simulation(Map* map, float blockSize);
+
+	void setTickDuration(int64 tickDuration);
+	int64 tickDuration() const { return _tickDuration; }
+	// Width of the screen in pixels, which is how much of the map is streamed.
+	void setScreenWidth(float screenWidth);
+
+	// Put a new ship at the beginning of the map.
+	void start(const ShipDef& shipDef);
+	unsigned tick(const SimInput& input); // Return SimEvent flags.
+	// Count the time since the crash. The game calls it on every tick,
+	// before tick() and even while paused.
+	void tickDeathTimer();
+	// Restore a state, e.g. a copy of state(). The ship definition and the
+	// map are not part of it.
+	void setState(const SimState& state) { _state = state; }
+
+	// Make sure the map is materialized where the ship is and ahead.
+	void streamMap();
+	// First column streamMap() keeps for state: the left of the screen or
+	// of the leftmost live part at the previous tick.
+	int streamBeginColumn(const SimState& state) const;
+
+	float warningScrollDist() const { return _state.shipHSpeed; }
+	bool isFinished() const;
+
+	const Map*      map()      const { return _map; }
+	const ShipDef&  shipDef()  const { return _shipDef; }
+	const SimState& state()    const { return _state; }
+	float           blockSize() const { return _blockSize; }
+
+private:
+	Box2 partBox         (unsigned part) const;
+	void updatePartBoxes ();
+	void sweptRow        (unsigned row, float minAmount);
+	void collide         ();
+	void collect         ();
+	void destroyPart     (unsigned part);
+
+private:
+	Map*     _map;
+	ShipDef  _shipDef;
+	SimState _state;
+
+	int64    _tickDuration;
+	float    _screenWidth;
+
+	// Collision state of the ship and its parts for the current tick, indexed
+	// by part, the ship itself being at index partCount.
+	std::vector<Box2>     _partBoxes;
+	unsigned              _partFirstRow; // Rows overlapped by any part.
+	unsigned              _partEndRow;
+	std::vector<float>    _partBumps;   // INFINITY if the part crashed.
+	std::vector<float>    _partTois;
+	std::vector<unsigned> _partPickups;
+
+	// Scratch buffers of the swept row tests.
+	std::vector<Map::SweptBox> _sweptBoxes;
+	std::vector<unsigned>      _sweptParts;
+	std::vector<int>           _sweptPoints;
+
+	// Constant params
+	float _blockSize;
+
+	float _hSpeedDamping;
+	float _acceleration;
+	float _minShipHSpeed;
+	float _brakingFactor;
+
+	float _thrustMaxCharge;
+	float _thrustRateCharge;
+	float _thrustPower;
+
+	float _vSpeedDamping;
+	float _vSpeedFloor;
+	float _vSpeedCap;
+	float _vLockFactor;
+
+	float _scratchThreshold;
+	float _crashThreshold;
+	float _bumpawayTime;
+
+	float _partBaseSpeed;
+	float _partDropSpeed;
+	float _snapDistance;
+	float _massRatio;
+
+	// Per-tick values of the factors above, set by setTickDuration().
+	float _tickBraking;
+	float _tickVDamping;
+	float _tickVLock;
+};
+
+
+#endif
@@ -47,8 +47,6 @@ SplashState::SplashState(Game* game)
       _initialized(false),
       _running(false),
       _loop(sys()),
-      _fpsTime(0),
-      _fpsCount(0),
 
       _skipInput(nullptr),
 
@@ -69,6 +67,7 @@ void SplashState::initialize() {
 	_loop.setTickDuration(    ONE_SEC /  60);
 	_loop.setFrameDuration(   ONE_SEC /  60);
 	_loop.setMaxFrameDuration(_loop.frameDuration() * 3);
+	_frameStats.setMaxFrameDuration(_loop.frameDuration() * 3);
 	_loop.setFrameMargin(     _loop.frameDuration() / 2);
 
 	window()->onResize.connect(std::bind(&SplashState::resizeEvent, this))
@@ -108,14 +107,16 @@ void SplashState::run() {
 	log().log("Starting splash state...");
 	_running = true;
 	_loop.start();
-	_fpsTime  = sys()->getTimeNs();
-	_fpsCount = 0;
+	_frameStats.startLoop(sys()->getTimeNs());
 
 	do {
 		switch(_loop.nextEvent()) {
-		case InterpLoop::Tick:
+		case InterpLoop::Tick: {
+			int64 begin = sys()->getTimeNs();
 			updateTick();
+			_frameStats.tick(begin, sys()->getTimeNs(), _loop.tickTime());
 			break;
+		}
 		case InterpLoop::Frame:
 			updateFrame();
 			break;
@@ -167,6 +168,8 @@ void SplashState::updateTick() {
 
 
 void SplashState::updateFrame() {
+	_frameStats.frame(sys()->getTimeNs());
+
 	// Rendering
 	Context* glc = renderer()->context();
 
@@ -179,16 +182,10 @@ void SplashState::updateFrame() {
 
 	_spriteRenderer.endFrame(_camera.transform());
 
+	int64 swapBegin = sys()->getTimeNs();
 	window()->swapBuffers();
+	_frameStats.swap(swapBegin, sys()->getTimeNs());
 	glc->setLogCalls(false);
-
-	uint64 now = sys()->getTimeNs();
-	++_fpsCount;
-	if(_fpsCount == 60) {
-		log().info("Fps: ", _fpsCount * float(ONE_SEC) / (now - _fpsTime));
-		_fpsTime  = now;
-		_fpsCount = 0;
-	}
 }
 
 
@@ -36,6 +36,8 @@
 #include <lair/ec/sprite_component.h>
 #include <lair/ec/bitmap_text_component.h>
 
+#include "frame_stats.h"
+
 
 using namespace lair;
 
@@ -65,6 +67,8 @@ public:
 	EntityRef loadEntity(const Path& path, EntityRef parent = EntityRef(),
 	                     const Path& cd = Path());
 
+	const FrameStats& frameStats() const { return _frameStats; }
+
 protected:
 	// More or less system stuff
 
@@ -81,8 +85,7 @@ protected:
 	bool        _initialized;
 	bool        _running;
 	InterpLoop  _loop;
-	int64       _fpsTime;
-	unsigned    _fpsCount;
+	FrameStats  _frameStats;
 
 	Input*      _skipInput;
 
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <lair/core/json.h>
+
+#include <lair/sys_sdl2/image_loader.h>
+
+#include "texture_atlas.h"
+
+
+TextureAtlas::TextureAtlas()
+	: _loader(nullptr),
+	  _renderer(nullptr) {
+}
+
+
+bool TextureAtlas::load(LoaderManager* loader, Renderer* renderer, const Path& dataPath,
+                        const Path& jsonPath, Logger& log) {
+	_loader   = loader;
+	_renderer = renderer;
+	_texture.reset();
+	_regions.clear();
+
+	Json::Value json;
+	if(!parseJson(json, dataPath / jsonPath, jsonPath, log)) {
+		log.warning("No texture atlas, images are loaded as separate textures.");
+		return false;
+	}
+
+	Path imagePath = dataPath / jsonPath.dir() / "atlas.png";
+	_texture = _renderer->createTexture(_loader->loadAsset<ImageLoader>(imagePath));
+
+	float width  = json["width"].asFloat();
+	float height = json["height"].asFloat();
+	const Json::Value& regions = json["regions"];
+	for(Json::Value::const_iterator it = regions.begin(); it != regions.end(); ++it) {
+		const Json::Value& rect = *it;
+		Vector2 min(rect[0].asFloat() / width, rect[1].asFloat() / height);
+		Vector2 size(rect[2].asFloat() / width, rect[3].asFloat() / height);
+		_regions.emplace(it.name(), Box2(min, min + size));
+	}
+
+	return true;
+}
+
+
+TextureAspectSP TextureAtlas::texture(const Path& image, Box2& texCoord) const {
+	RegionMap::const_iterator it = _regions.find(image.utf8CStr());
+	if(it != _regions.end()) {
+		texCoord = it->second;
+		return _texture;
+	}
+
+	texCoord = Box2(Vector2(0, 0), Vector2(1, 1));
+	return _renderer->createTexture(_loader->loadAsset<ImageLoader>(image));
+}
+
+
+Vector2 TextureAtlas::map(const Box2& texCoord, const Vector2& imageCoord) {
+	return texCoord.min() + texCoord.sizes().cwiseProduct(imageCoord);
+}
+
+
+Box2 TextureAtlas::map(const Box2& texCoord, const Box2& imageCoord) {
+	return Box2(map(texCoord, imageCoord.min()), map(texCoord, imageCoord.max()));
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_TEXTURE_ATLAS_H
+#define _LD35_TEXTURE_ATLAS_H
+
+
+#include <string>
+#include <unordered_map>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+
+#include <lair/render_gl2/texture.h>
+
+
+using namespace lair;
+
+
+// The texture atlas built by atlasc, and the rectangle of each image in it.
+// Images that are not in the atlas (or all of them if the atlas was not built)
+// are loaded as standalone textures, so callers do not need to care.
+//
+// Only the textures the game draws itself use it: tiles, warnings and beams.
+// The ship, parts, HUD, portraits and font are lair entities whose sprite and
+// text components load their textures by path, so they are not in the atlas
+// and each of them still costs its own draw calls.
+class TextureAtlas {
+public:
+	TextureAtlas();
+
+	// jsonPath is relative to dataPath (see buildDataPath()), and the atlas
+	// image is next to it.
+	bool load(LoaderManager* loader, Renderer* renderer, const Path& dataPath,
+	          const Path& jsonPath, Logger& log);
+
+	// Set texCoord to the texture coordinates of the image in the returned
+	// texture.
+	TextureAspectSP texture(const Path& image, Box2& texCoord) const;
+
+	// Map texture coordinates of an image to texture coordinates in its
+	// texture.
+	static Vector2 map(const Box2& texCoord, const Vector2& imageCoord);
+	static Box2    map(const Box2& texCoord, const Box2& imageCoord);
+
+private:
+	typedef std::unordered_map<std::string, Box2> RegionMap;
+
+	LoaderManager*  _loader;
+	Renderer*       _renderer;
+	TextureAspectSP _texture;
+	RegionMap       _regions;
+};
+
+
+#endif
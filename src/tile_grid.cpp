@@ -0,0 +1,263 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "gl_program.h"
+
+#include "tile_grid.h"
+
+
+enum {
+	ATTRIB_CORNER = 0,
+};
+
+
+// rect is the drawn area, in blocks relative to the first drawn column.
+static const char* gridVertSource =
+	"uniform mat4 viewMatrix;\n"
+	"uniform vec4 rect;\n"
+	"attribute vec2 vx_corner;\n"
+	"varying vec2 mapPos;\n"
+	"void main() {\n"
+	"	mapPos      = mix(rect.xy, rect.zw, vx_corner);\n"
+	"	gl_Position = viewMatrix * vec4(mapPos, 0., 1.);\n"
+	"}\n";
+
+// Texels hold the tile index + 1, 0 meaning empty.
+static const char* gridFragSource =
+	"#ifdef GL_ES\n"
+	"#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+	"precision highp float;\n"
+	"#else\n"
+	"precision mediump float;\n"
+	"#endif\n"
+	"#endif\n"
+	"uniform sampler2D grid;\n"
+	"uniform sampler2D tiles;\n"
+	"uniform vec2 gridSize;\n"
+	"uniform vec2 tileCount;\n"
+	"uniform vec4 tilesRect;\n"
+	"uniform float gridOffset;\n"
+	"varying vec2 mapPos;\n"
+	"void main() {\n"
+	"	vec2 block = floor(mapPos);\n"
+	"	vec2 texel = vec2(mod(block.x + gridOffset, gridSize.x), block.y);\n"
+	"	float tile = floor(texture2D(grid, (texel + .5) / gridSize).r * 255. + .5);\n"
+	"	if(tile < .5)\n"
+	"		discard;\n"
+	"	tile -= 1.;\n"
+	"	vec2 tilePos = vec2(mod(tile, tileCount.x), floor(tile / tileCount.x));\n"
+	"	vec2 tileCoord = (tilePos + fract(mapPos)) / tileCount;\n"
+	"	gl_FragColor = texture2D(tiles, tilesRect.xy + tileCoord * tilesRect.zw);\n"
+	"}\n";
+
+
+TileGrid::TileGrid()
+	: _glc(nullptr),
+	  _nRows(0),
+	  _chunkSize(0),
+	  _hTiles(1),
+	  _vTiles(1),
+	  _program(0),
+	  _viewMatrixLoc(-1),
+	  _rectLoc(-1),
+	  _gridLoc(-1),
+	  _tilesLoc(-1),
+	  _gridSizeLoc(-1),
+	  _tileCountLoc(-1),
+	  _tilesRectLoc(-1),
+	  _gridOffsetLoc(-1),
+	  _quadBuffer(0),
+	  _gridTex(0),
+	  _beginCol(0),
+	  _endCol(0) {
+}
+
+
+TileGrid::~TileGrid() {
+	lairAssert(!_program);
+}
+
+
+bool TileGrid::initialize(Context* glc, unsigned nRows, unsigned chunkSize,
+                          unsigned hTiles, unsigned vTiles, const Box2& tilesTexCoord) {
+	lairAssert(!_program);
+	lairAssert(nRows <= GRID_HEIGHT && GRID_WIDTH % chunkSize == 0);
+
+	_glc       = glc;
+	_nRows     = nRows;
+	_chunkSize = chunkSize;
+	_hTiles    = hTiles;
+	_vTiles    = vTiles;
+	_tilesTexCoord = tilesTexCoord;
+
+	AttribBinding attribs[] = {
+	    { ATTRIB_CORNER, "vx_corner" },
+	};
+	_program = createProgram(_glc, gridVertSource, gridFragSource, attribs, 1);
+	if(!_program)
+		return false;
+	_viewMatrixLoc = _glc->getUniformLocation(_program, "viewMatrix");
+	_rectLoc       = _glc->getUniformLocation(_program, "rect");
+	_gridLoc       = _glc->getUniformLocation(_program, "grid");
+	_tilesLoc      = _glc->getUniformLocation(_program, "tiles");
+	_gridSizeLoc   = _glc->getUniformLocation(_program, "gridSize");
+	_tileCountLoc  = _glc->getUniformLocation(_program, "tileCount");
+	_tilesRectLoc  = _glc->getUniformLocation(_program, "tilesRect");
+	_gridOffsetLoc = _glc->getUniformLocation(_program, "gridOffset");
+
+	float corners[] = { 0, 0,  1, 0,  0, 1,  0, 1,  1, 0,  1, 1 };
+	_glc->genBuffers(1, &_quadBuffer);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, _quadBuffer);
+	_glc->bufferData(gl::ARRAY_BUFFER, sizeof(corners), corners, gl::STATIC_DRAW);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, 0);
+
+	std::vector<uint8> empty(GRID_WIDTH * GRID_HEIGHT, 0);
+	_glc->genTextures(1, &_gridTex);
+	_glc->bindTexture(gl::TEXTURE_2D, _gridTex);
+	_glc->texParameteri(gl::TEXTURE_2D, gl::TEXTURE_MIN_FILTER, gl::NEAREST);
+	_glc->texParameteri(gl::TEXTURE_2D, gl::TEXTURE_MAG_FILTER, gl::NEAREST);
+	_glc->texParameteri(gl::TEXTURE_2D, gl::TEXTURE_WRAP_S, gl::CLAMP_TO_EDGE);
+	_glc->texParameteri(gl::TEXTURE_2D, gl::TEXTURE_WRAP_T, gl::CLAMP_TO_EDGE);
+	_glc->pixelStorei(gl::UNPACK_ALIGNMENT, 1);
+	_glc->texImage2D(gl::TEXTURE_2D, 0, gl::LUMINANCE, GRID_WIDTH, GRID_HEIGHT, 0,
+	                 gl::LUMINANCE, gl::UNSIGNED_BYTE, empty.data());
+	_glc->bindTexture(gl::TEXTURE_2D, 0);
+
+	return true;
+}
+
+
+void TileGrid::shutdown() {
+	if(!_program)
+		return;
+
+	_glc->deleteTextures(1, &_gridTex);
+	_glc->deleteBuffers(1, &_quadBuffer);
+	_glc->deleteProgram(_program);
+	_gridTex    = 0;
+	_quadBuffer = 0;
+	_program    = 0;
+}
+
+
+// Uploads whole chunks, so that the columns past the end of the map are
+// empty.
+void TileGrid::pushChunk(int firstCol, const uint32* walls, const uint32* points,
+                         unsigned count, int wallTile, int pointTile) {
+	if(!_program)
+		return;
+
+	if(_beginCol == _endCol)
+		_beginCol = firstCol;
+	_endCol = firstCol + count;
+
+	_texels.assign(_nRows * _chunkSize, 0);
+	for(unsigned row = 0; row < _nRows; ++row) {
+		uint32 bit = 1u << row;
+		uint8* texels = &_texels[row * _chunkSize];
+		for(unsigned ci = 0; ci < count; ++ci) {
+			if(walls[ci] & bit)
+				texels[ci] = wallTile + 1;
+			else if(points[ci] & bit)
+				texels[ci] = pointTile + 1;
+		}
+	}
+
+	_glc->bindTexture(gl::TEXTURE_2D, _gridTex);
+	_glc->pixelStorei(gl::UNPACK_ALIGNMENT, 1);
+	_glc->texSubImage2D(gl::TEXTURE_2D, 0, firstCol % GRID_WIDTH, 0, _chunkSize, _nRows,
+	                    gl::LUMINANCE, gl::UNSIGNED_BYTE, _texels.data());
+	_glc->bindTexture(gl::TEXTURE_2D, 0);
+}
+
+
+void TileGrid::popChunk() {
+	_beginCol = std::min(_beginCol + int(_chunkSize), _endCol);
+}
+
+
+void TileGrid::clear() {
+	_beginCol = 0;
+	_endCol   = 0;
+}
+
+
+void TileGrid::clearBlock(int col, unsigned row) {
+	if(!_program || col < _beginCol || col >= _endCol || row >= _nRows)
+		return;
+
+	uint8 empty = 0;
+	_glc->bindTexture(gl::TEXTURE_2D, _gridTex);
+	_glc->pixelStorei(gl::UNPACK_ALIGNMENT, 1);
+	_glc->texSubImage2D(gl::TEXTURE_2D, 0, col % GRID_WIDTH, row, 1, 1,
+	                    gl::LUMINANCE, gl::UNSIGNED_BYTE, &empty);
+	_glc->bindTexture(gl::TEXTURE_2D, 0);
+}
+
+
+unsigned TileGrid::render(const Matrix4& viewTransform, TextureSP tilesTex, float x0, float x1) {
+	x0 = std::max(x0, float(std::max(_beginCol, _endCol - int(GRID_WIDTH))));
+	x1 = std::min(x1, float(_endCol));
+	if(!_program || !tilesTex || x0 >= x1)
+		return 0;
+
+	// Work relative to the first drawn column to keep the precision of the
+	// shader computations whatever the length of the map.
+	int origin = std::floor(x0);
+	Matrix4 originTransform = Matrix4::Identity();
+	originTransform(0, 3) = origin;
+	Matrix4 view = viewTransform * originTransform;
+
+	_glc->useProgram(_program);
+	_glc->uniformMatrix4fv(_viewMatrixLoc, 1, false, view.data());
+	_glc->uniform4f(_rectLoc, x0 - origin, 0, x1 - origin, _nRows);
+	_glc->uniform1i(_gridLoc,  0);
+	_glc->uniform1i(_tilesLoc, 1);
+	_glc->uniform2f(_gridSizeLoc,  GRID_WIDTH, GRID_HEIGHT);
+	_glc->uniform2f(_tileCountLoc, _hTiles, _vTiles);
+	_glc->uniform4f(_tilesRectLoc, _tilesTexCoord.min()(0), _tilesTexCoord.min()(1),
+	                _tilesTexCoord.sizes()(0), _tilesTexCoord.sizes()(1));
+	_glc->uniform1f(_gridOffsetLoc, origin % GRID_WIDTH);
+
+	_glc->activeTexture(gl::TEXTURE1);
+	_glc->bindTexture(gl::TEXTURE_2D, tilesTex->id());
+	_glc->activeTexture(gl::TEXTURE0);
+	_glc->bindTexture(gl::TEXTURE_2D, _gridTex);
+
+	_glc->enable(gl::BLEND);
+	_glc->blendFunc(gl::SRC_ALPHA, gl::ONE_MINUS_SRC_ALPHA);
+
+	_glc->enableVertexAttribArray(ATTRIB_CORNER);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, _quadBuffer);
+	_glc->vertexAttribPointer(ATTRIB_CORNER, 2, gl::FLOAT, false, 0, 0);
+	_glc->drawArrays(gl::TRIANGLES, 0, 6);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, 0);
+	_glc->disableVertexAttribArray(ATTRIB_CORNER);
+
+	_glc->bindTexture(gl::TEXTURE_2D, 0);
+	_glc->useProgram(0);
+
+	return 1;
+}
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_TILE_GRID_H
+#define _LD35_TILE_GRID_H
+
+
+#include <vector>
+
+#include <lair/core/lair.h>
+
+#include <lair/render_gl2/context.h>
+#include <lair/render_gl2/texture.h>
+
+
+using namespace lair;
+
+
+// The tiles of the materialized chunks of a Map as a texture with a texel per
+// block, holding its tile index. The whole map is drawn with a single quad
+// whose fragment shader looks up the tile of each block in the tiles texture,
+// so the cost of drawing does not depend on the number of blocks. Columns are
+// stored in a ring of GRID_WIDTH texels: only the last GRID_WIDTH pushed
+// columns can be drawn, which is far more than a screen.
+class TileGrid {
+public:
+	enum {
+		GRID_WIDTH  = 4096,
+		GRID_HEIGHT = 32,
+	};
+
+public:
+	TileGrid();
+	TileGrid(const TileGrid&)  = delete;
+	TileGrid(      TileGrid&&) = delete;
+	~TileGrid();
+
+	TileGrid& operator=(const TileGrid&)  = delete;
+	TileGrid& operator=(      TileGrid&&) = delete;
+
+	// Tile i is the i-th tile of a hTiles x vTiles tile set, left to right
+	// and top to bottom, which covers tilesTexCoord in the tiles texture.
+	// Returns false if the shader could not be built.
+	bool initialize(Context* glc, unsigned nRows, unsigned chunkSize,
+	                unsigned hTiles, unsigned vTiles, const Box2& tilesTexCoord);
+	void shutdown();
+
+	bool isInitialized() const { return _program; }
+
+	// Same as TileMesh: chunks are pushed in column order and popped from the
+	// front. Walls (resp. points) use the tile wallTile (resp. pointTile).
+	void pushChunk(int firstCol, const uint32* walls, const uint32* points,
+	               unsigned count, int wallTile, int pointTile);
+	void popChunk();
+	void clear();
+
+	void clearBlock(int col, unsigned row);
+
+	// Draw columns [x0, x1) (in blocks, but not necessarily whole ones).
+	// viewTransform maps block coordinates to clip space. Returns the number
+	// of draw calls.
+	unsigned render(const Matrix4& viewTransform, TextureSP tilesTex, float x0, float x1);
+
+private:
+	Context*           _glc;
+	unsigned           _nRows;
+	unsigned           _chunkSize;
+	unsigned           _hTiles;
+	unsigned           _vTiles;
+	Box2               _tilesTexCoord;
+
+	GLuint             _program;
+	GLint              _viewMatrixLoc;
+	GLint              _rectLoc;
+	GLint              _gridLoc;
+	GLint              _tilesLoc;
+	GLint              _gridSizeLoc;
+	GLint              _tileCountLoc;
+	GLint              _tilesRectLoc;
+	GLint              _gridOffsetLoc;
+	GLuint             _quadBuffer;
+	GLuint             _gridTex;
+
+	// Materialized columns.
+	int                _beginCol;
+	int                _endCol;
+	std::vector<uint8> _texels;
+};
+
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <cstddef>
+
+#include "gl_program.h"
+
+#include "tile_mesh.h"
+
+
+enum {
+	ATTRIB_POSITION = 0,
+	ATTRIB_TEXCOORD = 1,
+};
+
+
+static const char* tileVertSource =
+	"uniform mat4 viewMatrix;\n"
+	"attribute vec4 vx_position;\n"
+	"attribute vec2 vx_texCoord;\n"
+	"varying vec2 texCoord;\n"
+	"void main() {\n"
+	"	gl_Position = viewMatrix * vx_position;\n"
+	"	texCoord    = vx_texCoord;\n"
+	"}\n";
+
+static const char* tileFragSource =
+	"#ifdef GL_ES\n"
+	"precision mediump float;\n"
+	"#endif\n"
+	"uniform sampler2D texture;\n"
+	"varying vec2 texCoord;\n"
+	"void main() {\n"
+	"	gl_FragColor = texture2D(texture, texCoord);\n"
+	"}\n";
+
+
+TileMesh::TileMesh()
+	: _glc(nullptr),
+	  _nRows(0),
+	  _chunkSize(0),
+	  _program(0),
+	  _viewMatrixLoc(-1),
+	  _textureLoc(-1),
+	  _indexBuffer(0) {
+}
+
+
+TileMesh::~TileMesh() {
+	lairAssert(!_program);
+}
+
+
+bool TileMesh::initialize(Context* glc, unsigned nRows, unsigned chunkSize,
+                          const Box2& wallTexCoord, const Box2& pointTexCoord) {
+	lairAssert(!_program);
+	// Quads of a chunk must be indexable with 16-bit indices.
+	lairAssert(nRows * chunkSize * 4 <= 65536);
+
+	_glc           = glc;
+	_nRows         = nRows;
+	_chunkSize     = chunkSize;
+	_wallTexCoord  = wallTexCoord;
+	_pointTexCoord = pointTexCoord;
+
+	AttribBinding attribs[] = {
+	    { ATTRIB_POSITION, "vx_position" },
+	    { ATTRIB_TEXCOORD, "vx_texCoord" },
+	};
+	_program = createProgram(_glc, tileVertSource, tileFragSource, attribs, 2);
+	if(!_program)
+		return false;
+	_viewMatrixLoc = _glc->getUniformLocation(_program, "viewMatrix");
+	_textureLoc    = _glc->getUniformLocation(_program, "texture");
+
+	// All chunks share the same index buffer, big enough for a full chunk.
+	unsigned maxQuads = _nRows * _chunkSize;
+	std::vector<uint16> indices;
+	indices.reserve(maxQuads * 6);
+	for(unsigned quad = 0; quad < maxQuads; ++quad) {
+		uint16 index = quad * 4;
+		indices.push_back(index + 0);
+		indices.push_back(index + 1);
+		indices.push_back(index + 2);
+		indices.push_back(index + 2);
+		indices.push_back(index + 1);
+		indices.push_back(index + 3);
+	}
+	_glc->genBuffers(1, &_indexBuffer);
+	_glc->bindBuffer(gl::ELEMENT_ARRAY_BUFFER, _indexBuffer);
+	_glc->bufferData(gl::ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16),
+	                 indices.data(), gl::STATIC_DRAW);
+	_glc->bindBuffer(gl::ELEMENT_ARRAY_BUFFER, 0);
+
+	return true;
+}
+
+
+void TileMesh::shutdown() {
+	if(!_program)
+		return;
+
+	clear();
+	_glc->deleteBuffers(1, &_indexBuffer);
+	_glc->deleteProgram(_program);
+	_indexBuffer = 0;
+	_program     = 0;
+}
+
+
+void TileMesh::pushChunk(int firstCol, const uint32* walls, const uint32* points,
+                         unsigned count) {
+	if(!_program)
+		return;
+
+	Chunk chunk;
+	chunk.firstCol = firstCol;
+	chunk.count    = count;
+	chunk.blocks.resize(count);
+	chunk.firstQuad.resize(count);
+
+	_vertices.clear();
+	for(unsigned ci = 0; ci < count; ++ci) {
+		chunk.blocks[ci]    = walls[ci] | points[ci];
+		chunk.firstQuad[ci] = _vertices.size() / 4;
+
+		for(unsigned row = 0; row < _nRows; ++row) {
+			uint32 bit = 1u << row;
+			if(walls[ci] & bit)
+				addQuad(firstCol + ci, row, _wallTexCoord);
+			else if(points[ci] & bit)
+				addQuad(firstCol + ci, row, _pointTexCoord);
+		}
+	}
+	chunk.quadCount = _vertices.size() / 4;
+
+	_glc->genBuffers(1, &chunk.buffer);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, chunk.buffer);
+	_glc->bufferData(gl::ARRAY_BUFFER, _vertices.size() * sizeof(Vertex),
+	                 _vertices.data(), gl::STATIC_DRAW);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, 0);
+
+	_chunks.push_back(std::move(chunk));
+}
+
+
+void TileMesh::popChunk() {
+	if(_chunks.empty())
+		return;
+
+	_glc->deleteBuffers(1, &_chunks.front().buffer);
+	_chunks.pop_front();
+}
+
+
+void TileMesh::clear() {
+	while(!_chunks.empty())
+		popChunk();
+}
+
+
+// Collapse the quad of the block so that it is not rasterized anymore.
+void TileMesh::clearBlock(int col, unsigned row) {
+	if(_chunks.empty() || col < _chunks.front().firstCol)
+		return;
+
+	unsigned ci = (col - _chunks.front().firstCol) / _chunkSize;
+	if(ci >= _chunks.size())
+		return;
+	Chunk& chunk = _chunks[ci];
+	unsigned bi = col - chunk.firstCol;
+	uint32 bit = 1u << row;
+	if(bi >= chunk.count || !(chunk.blocks[bi] & bit))
+		return;
+
+	unsigned quad = chunk.firstQuad[bi];
+	for(uint32 below = chunk.blocks[bi] & (bit - 1); below; below &= below - 1)
+		++quad;
+
+	Vertex empty[4] = {};
+	_glc->bindBuffer(gl::ARRAY_BUFFER, chunk.buffer);
+	_glc->bufferSubData(gl::ARRAY_BUFFER, quad * sizeof(empty), sizeof(empty), empty);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, 0);
+}
+
+
+unsigned TileMesh::render(const Matrix4& viewTransform, TextureSP tilesTex,
+                          int beginCol, int endCol) {
+	if(!_program || !tilesTex)
+		return 0;
+
+	_glc->useProgram(_program);
+	_glc->uniformMatrix4fv(_viewMatrixLoc, 1, false, viewTransform.data());
+	_glc->uniform1i(_textureLoc, 0);
+	_glc->activeTexture(gl::TEXTURE0);
+	_glc->bindTexture(gl::TEXTURE_2D, tilesTex->id());
+
+	_glc->enable(gl::BLEND);
+	_glc->blendFunc(gl::SRC_ALPHA, gl::ONE_MINUS_SRC_ALPHA);
+
+	_glc->enableVertexAttribArray(ATTRIB_POSITION);
+	_glc->enableVertexAttribArray(ATTRIB_TEXCOORD);
+	_glc->bindBuffer(gl::ELEMENT_ARRAY_BUFFER, _indexBuffer);
+	unsigned drawCalls = 0;
+	for(const Chunk& chunk: _chunks) {
+		if(chunk.firstCol + int(chunk.count) <= beginCol || chunk.firstCol >= endCol
+		|| chunk.quadCount == 0)
+			continue;
+
+		_glc->bindBuffer(gl::ARRAY_BUFFER, chunk.buffer);
+		_glc->vertexAttribPointer(ATTRIB_POSITION, 2, gl::FLOAT, false, sizeof(Vertex),
+		                          reinterpret_cast<const void*>(offsetof(Vertex, x)));
+		_glc->vertexAttribPointer(ATTRIB_TEXCOORD, 2, gl::FLOAT, false, sizeof(Vertex),
+		                          reinterpret_cast<const void*>(offsetof(Vertex, u)));
+		_glc->drawElements(gl::TRIANGLES, chunk.quadCount * 6, gl::UNSIGNED_SHORT, 0);
+		++drawCalls;
+	}
+	_glc->bindBuffer(gl::ELEMENT_ARRAY_BUFFER, 0);
+	_glc->bindBuffer(gl::ARRAY_BUFFER, 0);
+	_glc->disableVertexAttribArray(ATTRIB_POSITION);
+	_glc->disableVertexAttribArray(ATTRIB_TEXCOORD);
+	_glc->useProgram(0);
+
+	return drawCalls;
+}
+
+
+void TileMesh::addQuad(int col, unsigned row, const Box2& texCoord) {
+	float x0 = col;
+	float y0 = row;
+	_vertices.push_back(Vertex{ x0,     y0,     texCoord.min()(0), texCoord.min()(1) });
+	_vertices.push_back(Vertex{ x0 + 1, y0,     texCoord.max()(0), texCoord.min()(1) });
+	_vertices.push_back(Vertex{ x0,     y0 + 1, texCoord.min()(0), texCoord.max()(1) });
+	_vertices.push_back(Vertex{ x0 + 1, y0 + 1, texCoord.max()(0), texCoord.max()(1) });
+}
@@ -0,0 +1,116 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef _LD35_TILE_MESH_H
+#define _LD35_TILE_MESH_H
+
+
+#include <deque>
+#include <vector>
+
+#include <lair/core/lair.h>
+
+#include <lair/render_gl2/context.h>
+#include <lair/render_gl2/texture.h>
+
+
+using namespace lair;
+
+
+// The static tile geometry of the materialized chunks of a Map. Each chunk
+// gets a vertex buffer, built once when it is pushed and drawn every frame
+// with a single draw call, in block units so that scrolling only changes the
+// view matrix. The only update is clearBlock(), which patches in place the
+// quad of a picked up point.
+class TileMesh {
+public:
+	TileMesh();
+	TileMesh(const TileMesh&)  = delete;
+	TileMesh(      TileMesh&&) = delete;
+	~TileMesh();
+
+	TileMesh& operator=(const TileMesh&)  = delete;
+	TileMesh& operator=(      TileMesh&&) = delete;
+
+	// Blocks of walls (resp. points) are textured with wallTexCoord (resp.
+	// pointTexCoord). Returns false if the shader could not be built.
+	bool initialize(Context* glc, unsigned nRows, unsigned chunkSize,
+	                const Box2& wallTexCoord, const Box2& pointTexCoord);
+	void shutdown();
+
+	bool isInitialized() const { return _program; }
+
+	// Chunks are pushed in column order and popped from the front, like the
+	// chunks of the Map.
+	void pushChunk(int firstCol, const uint32* walls, const uint32* points,
+	               unsigned count);
+	void popChunk();
+	void clear();
+
+	void clearBlock(int col, unsigned row);
+
+	// Draw the chunks that overlap [beginCol, endCol). viewTransform maps
+	// block coordinates to clip space. Returns the number of draw calls.
+	unsigned render(const Matrix4& viewTransform, TextureSP tilesTex,
+	            int beginCol, int endCol);
+
+private:
+	struct Vertex {
+		float x;
+		float y;
+		float u;
+		float v;
+	};
+	typedef std::vector<Vertex> VertexVector;
+
+	struct Chunk {
+		int                 firstCol;
+		unsigned            count;
+		GLuint              buffer;
+		unsigned            quadCount;
+		// Blocks drawn in each column and index of the first quad of each
+		// column, to find the quad of a block.
+		std::vector<uint32> blocks;
+		std::vector<uint16> firstQuad;
+	};
+	typedef std::deque<Chunk> ChunkDeque;
+
+	void addQuad(int col, unsigned row, const Box2& texCoord);
+
+private:
+	Context*     _glc;
+	unsigned     _nRows;
+	unsigned     _chunkSize;
+	Box2         _wallTexCoord;
+	Box2         _pointTexCoord;
+
+	GLuint       _program;
+	GLint        _viewMatrixLoc;
+	GLint        _textureLoc;
+	GLuint       _indexBuffer;
+
+	ChunkDeque   _chunks;
+	VertexVector _vertices;
+};
+
+
+#endif
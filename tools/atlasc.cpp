@@ -0,0 +1,206 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+// atlasc: pack images into a texture atlas, so that the sprites that use them
+// can be drawn in the same batch.
+//
+// Usage: atlasc <atlas.json> <atlas.png> <assets-dir> <image>...
+//
+// Images are read from <assets-dir>. <atlas.json> maps each image path to its
+// rectangle in <atlas.png>, in pixels, as [x, y, width, height].
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include <lair/core/lair.h>
+#include <lair/core/json.h>
+
+
+#define ATLAS_WIDTH 2048
+#define ATLAS_MAX_HEIGHT 4096
+// Images are extruded by this many pixels on each side and their cells are
+// aligned on it, so that neither bilinear filtering nor the first three mip
+// levels bleed the neighbors in. The game samples the atlas with BILINEAR
+// anyway: deeper mip levels would mix images whatever the padding.
+#define PADDING 8
+
+
+using namespace lair;
+
+
+struct Image {
+	std::string  path;
+	SDL_Surface* surface;
+	int          x;
+	int          y;
+};
+
+
+int alignUp(int size) {
+	return (size + PADDING - 1) / PADDING * PADDING;
+}
+
+
+// Shelf packing, highest images first.
+int pack(std::vector<Image*>& images) {
+	std::sort(images.begin(), images.end(), [](const Image* a, const Image* b) {
+		return a->surface->h > b->surface->h;
+	});
+
+	int x = 0;
+	int y = 0;
+	int shelfHeight = 0;
+	for(Image* img: images) {
+		int w = alignUp(img->surface->w + 2 * PADDING);
+		int h = alignUp(img->surface->h + 2 * PADDING);
+		if(w > ATLAS_WIDTH)
+			return -1;
+		if(x + w > ATLAS_WIDTH) {
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		img->x = x + PADDING;
+		img->y = y + PADDING;
+		x += w;
+		shelfHeight = std::max(shelfHeight, h);
+	}
+
+	int height = 1;
+	while(height < y + shelfHeight)
+		height *= 2;
+	return height;
+}
+
+
+// Copy the image and extrude its borders into the padding.
+void blit(SDL_Surface* atlas, const Image& img) {
+	const SDL_Surface* src = img.surface;
+	uint32* dst = static_cast<uint32*>(atlas->pixels);
+	int stride = atlas->pitch / 4;
+	for(int y = -PADDING; y < src->h + PADDING; ++y) {
+		int sy = std::max(0, std::min(y, src->h - 1));
+		const uint32* srcRow = reinterpret_cast<const uint32*>(
+		            static_cast<const uint8*>(src->pixels) + sy * src->pitch);
+		uint32* dstRow = dst + (img.y + y) * stride + img.x;
+		for(int x = -PADDING; x < src->w + PADDING; ++x) {
+			dstRow[x] = srcRow[std::max(0, std::min(x, src->w - 1))];
+		}
+	}
+}
+
+
+int main(int argc, char** argv) {
+	if(argc < 5) {
+		fprintf(stderr, "Usage: %s <atlas.json> <atlas.png> <assets-dir> <image>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::string assetsDir = argv[3];
+
+	IMG_Init(IMG_INIT_PNG);
+
+	// Byte order R, G, B, A.
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	Uint32 format = SDL_PIXELFORMAT_RGBA8888;
+#else
+	Uint32 format = SDL_PIXELFORMAT_ABGR8888;
+#endif
+
+	bool ok = true;
+	std::vector<Image> images;
+	for(int i = 4; ok && i < argc; ++i) {
+		std::string path = assetsDir + "/" + argv[i];
+		SDL_Surface* surface = IMG_Load(path.c_str());
+		SDL_Surface* rgba = surface? SDL_ConvertSurfaceFormat(surface, format, 0): nullptr;
+		SDL_FreeSurface(surface);
+		if(!rgba) {
+			fprintf(stderr, "atlasc: failed to load \"%s\": %s\n", path.c_str(), IMG_GetError());
+			ok = false;
+			break;
+		}
+		images.push_back(Image{ argv[i], rgba, 0, 0 });
+	}
+
+	std::vector<Image*> order;
+	for(Image& img: images)
+		order.push_back(&img);
+	int height = ok? pack(order): -1;
+	if(ok && (height < 0 || height > ATLAS_MAX_HEIGHT)) {
+		fprintf(stderr, "atlasc: images do not fit in a %dx%d atlas\n",
+		        ATLAS_WIDTH, ATLAS_MAX_HEIGHT);
+		ok = false;
+	}
+
+	if(ok) {
+		SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, ATLAS_WIDTH, height, 32, format);
+		SDL_FillRect(atlas, nullptr, 0);
+		Json::Value regions(Json::objectValue);
+		for(const Image& img: images) {
+			SDL_LockSurface(img.surface);
+			blit(atlas, img);
+			SDL_UnlockSurface(img.surface);
+
+			Json::Value rect(Json::arrayValue);
+			rect.append(img.x);
+			rect.append(img.y);
+			rect.append(img.surface->w);
+			rect.append(img.surface->h);
+			regions[img.path] = rect;
+		}
+
+		if(IMG_SavePNG(atlas, argv[2]) != 0) {
+			fprintf(stderr, "atlasc: failed to write \"%s\": %s\n", argv[2], IMG_GetError());
+			ok = false;
+		}
+		SDL_FreeSurface(atlas);
+
+		Json::Value json(Json::objectValue);
+		json["width"]   = ATLAS_WIDTH;
+		json["height"]  = height;
+		json["regions"] = regions;
+		std::ofstream out(argv[1]);
+		out << json;
+		if(!out) {
+			fprintf(stderr, "atlasc: failed to write \"%s\"\n", argv[1]);
+			ok = false;
+		}
+
+		if(ok)
+			printf("atlasc: %s: %u images in %dx%d\n", argv[2], unsigned(images.size()),
+			       ATLAS_WIDTH, height);
+	}
+
+	for(Image& img: images)
+		SDL_FreeSurface(img.surface);
+	IMG_Quit();
+
+	return ok? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,193 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+// batch: play many runs of every level of maps.json on all cores, without a
+// window, and sum up how they went. For difficulty tuning and regression
+// sweeps (see BatchSimulation).
+//
+// Usage: batch [--assets <dir>] [--level <n>] [--runs <n>] [--ticks <n>]
+//              [--tick-rate <n>] [--seed <n>] [--input <script>]
+//
+// Each level is played --runs times, for at most --ticks ticks each, by the
+// random bot with seeds from --seed on, or with the script if there is one.
+// The levels must be compiled (see levelc).
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+#include <lair/core/json.h>
+
+#include "batch_simulation.h"
+#include "parallel.h"
+
+
+// As in MainState.
+#define BLOCK_SIZE 48
+
+
+using namespace lair;
+
+
+template<typename T>
+T percentile(std::vector<T> values, double p) {
+	if(values.empty())
+		return T();
+	std::sort(values.begin(), values.end());
+	return values[std::min<size_t>(p / 100 * values.size(), values.size() - 1)];
+}
+
+
+void printLevel(unsigned level, int length, const std::vector<SimRunResult>& results) {
+	std::vector<float>    scores;
+	std::vector<float>    distances;
+	std::map<int, unsigned> deaths;
+	unsigned finishes = 0;
+	uint64   ticks    = 0;
+	for(const SimRunResult& r: results) {
+		scores.push_back(r.score * 1000);
+		distances.push_back(r.distance / 1000);
+		finishes += r.finished;
+		ticks    += r.ticks;
+		if(r.deathColumn >= 0)
+			++deaths[r.deathColumn];
+	}
+
+	printf("level %u (%d columns): %u/%zu finished, %.0f ticks/run\n", level, length,
+	       finishes, results.size(), double(ticks) / results.size());
+	printf("  score    p50 %8.0f  p90 %8.0f  max %8.0f\n", percentile(scores, 50),
+	       percentile(scores, 90), percentile(scores, 100));
+	printf("  distance p50 %8.2f  p90 %8.2f  max %8.2f km\n", percentile(distances, 50),
+	       percentile(distances, 90), percentile(distances, 100));
+
+	std::vector<std::pair<unsigned, int>> worst;
+	for(const auto& death: deaths)
+		worst.push_back(std::make_pair(death.second, death.first));
+	std::sort(worst.rbegin(), worst.rend());
+	if(!worst.empty()) {
+		printf("  deadliest columns:");
+		for(unsigned i = 0; i < std::min<size_t>(5, worst.size()); ++i)
+			printf(" %d (%u)", worst[i].second, worst[i].first);
+		printf("\n");
+	}
+}
+
+
+int main(int argc, char** argv) {
+	typedef std::chrono::steady_clock Clock;
+
+	std::string assetsDir = "assets";
+	int         onlyLevel = -1;
+	unsigned    nRuns     = 1000;
+	unsigned    maxTicks  = 60 * 60 * 10;
+	unsigned    tickRate  = 60;
+	uint32      seed      = 1;
+	InputScript script;
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if(i + 1 == argc) {
+			fprintf(stderr, "batch: missing value for %s\n", arg.c_str());
+			return EXIT_FAILURE;
+		}
+		if(arg == "--assets")
+			assetsDir = argv[++i];
+		else if(arg == "--level")
+			onlyLevel = std::strtol(argv[++i], nullptr, 10);
+		else if(arg == "--runs")
+			nRuns = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--ticks")
+			maxTicks = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--tick-rate")
+			tickRate = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--seed")
+			seed = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--input") {
+			if(!script.load(argv[++i], dbgLogger))
+				return EXIT_FAILURE;
+		}
+		else {
+			fprintf(stderr, "Usage: %s [--assets <dir>] [--level <n>] [--runs <n>]"
+			                " [--ticks <n>] [--tick-rate <n>] [--seed <n>]"
+			                " [--input <script>]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(nRuns == 0) {
+		fprintf(stderr, "batch: there must be at least one run per level\n");
+		return EXIT_FAILURE;
+	}
+	if(tickRate < MIN_TICK_RATE || tickRate > MAX_TICK_RATE) {
+		fprintf(stderr, "batch: tick rate must be in [%d, %d]\n",
+		        MIN_TICK_RATE, MAX_TICK_RATE);
+		return EXIT_FAILURE;
+	}
+
+	Json::Value maps;
+	Path mapsPath = Path(assetsDir) / "maps.json";
+	if(!parseJson(maps, mapsPath, "maps.json", dbgLogger))
+		return EXIT_FAILURE;
+
+	BatchSimulation batch(BLOCK_SIZE);
+	batch.setTickDuration(ONE_SEC / tickRate);
+	if(!batch.loadLevels(Path(assetsDir), maps, dbgLogger))
+		return EXIT_FAILURE;
+
+	std::vector<SimRun> runs;
+	for(unsigned level = 0; level < batch.levelCount(); ++level) {
+		if(!batch.hasLevel(level) || (onlyLevel >= 0 && int(level) != onlyLevel))
+			continue;
+		for(unsigned i = 0; i < nRuns; ++i) {
+			SimRun run = { level, script.empty()? nullptr: &script, randomBot,
+			               seed + i, maxTicks };
+			runs.push_back(run);
+		}
+	}
+	if(runs.empty()) {
+		fprintf(stderr, "batch: no level to play\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<SimRunResult> results;
+	Clock::time_point start = Clock::now();
+	batch.run(runs, results);
+	double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+	uint64 ticks = 0;
+	for(unsigned begin = 0; begin < runs.size(); begin += nRuns) {
+		std::vector<SimRunResult> levelResults(results.begin() + begin,
+		                                       results.begin() + begin + nRuns);
+		for(const SimRunResult& r: levelResults)
+			ticks += r.ticks;
+		printLevel(runs[begin].level, batch.levelLength(runs[begin].level), levelResults);
+	}
+	printf("%zu runs, %llu ticks in %.3f s on %u threads: %.0f ticks/s\n", runs.size(),
+	       (unsigned long long)ticks, secs, workerCount(), ticks / secs);
+
+	return EXIT_SUCCESS;
+}
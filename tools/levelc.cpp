@@ -0,0 +1,187 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// levelc: compile the levels described in maps.json into binary files that
+// the game can memory-map, so that level start does not decode any image.
+//
+// Usage: levelc <maps.json> <assets-dir> <out-dir>
+//
+// Segments are read from <assets-dir> and compiled levels are written to
+// <out-dir>/levels/; the game looks for them in the build data directory
+// (see buildDataPath()). Levels that are complete and up to date with their
+// segment list and images (see hashSegments()) are skipped, so it is cheap to
+// run on every build.
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include <lair/core/lair.h>
+#include <lair/core/json.h>
+
+#include "blocks.h"
+#include "level_file.h"
+
+
+#define N_ROWS 22
+
+
+using namespace lair;
+
+
+typedef std::vector<uint32> ColumnVector;
+
+
+bool appendSegment(ColumnVector& walls, ColumnVector& points,
+                   const std::string& path) {
+	SDL_Surface* surface = IMG_Load(path.c_str());
+	if(!surface) {
+		fprintf(stderr, "levelc: failed to load \"%s\": %s\n", path.c_str(), IMG_GetError());
+		return false;
+	}
+
+	// Byte order R, G, B, A.
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	Uint32 format = SDL_PIXELFORMAT_RGBA8888;
+#else
+	Uint32 format = SDL_PIXELFORMAT_ABGR8888;
+#endif
+	SDL_Surface* rgba = SDL_ConvertSurfaceFormat(surface, format, 0);
+	SDL_FreeSurface(surface);
+	if(!rgba) {
+		fprintf(stderr, "levelc: failed to convert \"%s\": %s\n", path.c_str(), SDL_GetError());
+		return false;
+	}
+	if(rgba->h > N_ROWS) {
+		fprintf(stderr, "levelc: \"%s\" is higher than %d pixels\n", path.c_str(), N_ROWS);
+		SDL_FreeSurface(rgba);
+		return false;
+	}
+
+	size_t begin = walls.size();
+	walls .resize(begin + rgba->w);
+	points.resize(begin + rgba->w);
+
+	SDL_LockSurface(rgba);
+	classifyColumns(static_cast<const uint8*>(rgba->pixels), 4, rgba->pitch,
+	                rgba->w, rgba->h, 0, rgba->w,
+	                walls.data() + begin, points.data() + begin);
+	SDL_UnlockSurface(rgba);
+	SDL_FreeSurface(rgba);
+
+	return true;
+}
+
+
+// Like checkLevelFile(), without reading the columns: a truncated file is out
+// of date too.
+bool isUpToDate(const std::string& path, uint32 segmentsHash) {
+	LevelFileHeader header;
+	std::ifstream in(path, std::ios::binary);
+	in.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if(!in)
+		return false;
+	in.seekg(0, std::ios::end);
+	std::streamoff size = in.tellg();
+	return std::strncmp(header.magic, LEVEL_FILE_MAGIC, sizeof(header.magic)) == 0
+	    && header.version == LEVEL_FILE_VERSION
+	    && header.nRows == N_ROWS
+	    && header.segmentsHash == segmentsHash
+	    && size == std::streamoff(sizeof(header) + 2 * sizeof(uint32) * size_t(header.length));
+}
+
+
+bool compileLevel(const Json::Value& info, const std::string& assetsDir,
+                  const std::string& outPath) {
+	const Json::Value& segments = info["segments"];
+	uint32 segmentsHash = hashSegments(segments, Path(assetsDir));
+	if(isUpToDate(outPath, segmentsHash))
+		return true;
+
+	ColumnVector walls;
+	ColumnVector points;
+	for(unsigned i = 0; i < segments.size(); ++i) {
+		std::string segment = segments[i].asString();
+		if(segment.empty())
+			continue;
+		if(!appendSegment(walls, points, assetsDir + "/" + segment))
+			return false;
+	}
+
+	LevelFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::strncpy(header.magic, LEVEL_FILE_MAGIC, sizeof(header.magic));
+	header.version      = LEVEL_FILE_VERSION;
+	header.nRows        = N_ROWS;
+	header.length       = walls.size();
+	header.segmentsHash = segmentsHash;
+
+	std::ofstream out(outPath, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(walls.data()),  walls.size()  * sizeof(uint32));
+	out.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(uint32));
+	if(!out) {
+		fprintf(stderr, "levelc: failed to write \"%s\"\n", outPath.c_str());
+		return false;
+	}
+
+	printf("levelc: %s: %u columns\n", outPath.c_str(), header.length);
+	return true;
+}
+
+
+int main(int argc, char** argv) {
+	if(argc != 4) {
+		fprintf(stderr, "Usage: %s <maps.json> <assets-dir> <out-dir>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::string assetsDir = argv[2];
+	std::string outDir    = argv[3];
+
+	Json::Value maps;
+	Json::Reader reader;
+	std::ifstream in(argv[1]);
+	if(!reader.parse(in, maps) || !maps.isArray()) {
+		fprintf(stderr, "levelc: failed to parse \"%s\": %s\n", argv[1],
+		        reader.getFormattedErrorMessages().c_str());
+		return EXIT_FAILURE;
+	}
+
+	IMG_Init(IMG_INIT_PNG);
+
+	bool ok = true;
+	for(unsigned level = 0; ok && level < maps.size(); ++level) {
+		// Generated levels are built at level start from the seed.
+		if(maps[level].isMember("generate"))
+			continue;
+		ok = compileLevel(maps[level], assetsDir, outDir + "/" + levelFilePath(level));
+	}
+
+	IMG_Quit();
+
+	return ok? EXIT_SUCCESS: EXIT_FAILURE;
+}
@@ -0,0 +1,272 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+// simulate: run the game physics on a level without a window, as fast as
+// possible.
+//
+// Usage: simulate [--assets <dir>] [--level <n>] [--ticks <n>]
+//                 [--tick-rate <n>] [--input <script>] [--expect-hash <hex>]
+//        simulate [--assets <dir>] --replay <file.rec>
+//
+// The level must be compiled (see levelc). The ship restarts the level when
+// it crashes or reaches the end, like in the game. Without a script (see
+// InputScript), it just holds accel.
+//
+// It prints the hash of the states of every tick (see hashSimState()). With
+// --expect-hash, it fails if the hash is not the one given, e.g. the one of
+// another build: SHAPEOUT_DETERMINISTIC builds must all agree.
+//
+// With --replay, it plays a session recorded by the game (--record) through
+// the GameFlow of the game, with its level changes and dialog pauses, and
+// fails if it does not end in the recorded state.
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+#include <lair/core/json.h>
+
+#include "level_file.h"
+#include "input_script.h"
+#include "input_log.h"
+#include "game_flow.h"
+#include "ship_parts.h"
+#include "simulation.h"
+#include "map.h"
+
+
+// As in MainState.
+#define BLOCK_SIZE 48
+
+
+using namespace lair;
+
+
+bool parseJsonFile(Json::Value& json, const std::string& path) {
+	Json::Reader reader;
+	std::ifstream in(path);
+	if(!reader.parse(in, json)) {
+		fprintf(stderr, "simulate: failed to parse \"%s\": %s\n", path.c_str(),
+		        reader.getFormattedErrorMessages().c_str());
+		return false;
+	}
+	return true;
+}
+
+
+bool loadLevel(Map& map, const Json::Value& info, const std::string& assetsDir,
+               unsigned level) {
+	if(info.isMember("generate")) {
+		fprintf(stderr, "simulate: generated levels are not supported\n");
+		return false;
+	}
+
+	Path levelPath = buildDataPath(Path(assetsDir)) / Path(levelFilePath(level));
+	if(!map.loadCompiled(levelPath, hashSegments(info["segments"], Path(assetsDir)))) {
+		fprintf(stderr, "simulate: no up to date \"%s\", build the levels target\n",
+		        levelPath.utf8CStr());
+		return false;
+	}
+	return true;
+}
+
+
+int replay(const std::string& assetsDir, const std::string& recPath) {
+	InputLog log;
+	if(!log.load(recPath, dbgLogger))
+		return EXIT_FAILURE;
+
+	Json::Value maps;
+	Json::Value animations;
+	if(!parseJsonFile(maps, assetsDir + "/maps.json")
+	|| !parseJsonFile(animations, assetsDir + "/animations.json"))
+		return EXIT_FAILURE;
+
+	Map map(nullptr, BLOCK_SIZE);
+	Simulation sim(&map, BLOCK_SIZE);
+	sim.setTickDuration(ONE_SEC / log.tickRate());
+	GameFlow flow(&map, &sim, BLOCK_SIZE);
+	flow.setup(Path(assetsDir), maps, animations, dbgLogger);
+	if(!flow.startLevel(log.level()))
+		return EXIT_FAILURE;
+
+	uint8 inputs = 0;
+	while(log.replay(&inputs)) {
+		if(flow.tick(inputs) & FLOW_GAME_OVER)
+			break;
+	}
+
+	const InputLogHeader& end = log.header();
+	const SimState& state = sim.state();
+	printf("%u ticks at %u ticks/s\n", log.tickCount(), log.tickRate());
+	printf("level: %d (%u)\n", flow.level(), end.endLevel);
+	printf("score: %.0f (%.0f)\n", state.score * 1000, end.endScore * 1000);
+	printf("distance: %.2f km (%.2f km)\n", state.distance / 1000, end.endDistance / 1000);
+	printf("state hash: %016llx (%016llx)\n", (unsigned long long)flow.hash(),
+	       (unsigned long long)end.endHash);
+
+	if(!log.isReplayDone() || unsigned(flow.level()) != end.endLevel
+	|| flow.hash() != end.endHash || state.score != end.endScore
+	|| state.distance != end.endDistance) {
+		fprintf(stderr, "simulate: the replay diverged from the recording\n");
+		if(!end.deterministic)
+			fprintf(stderr, "simulate: it was not recorded by a SHAPEOUT_DETERMINISTIC build\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char** argv) {
+	typedef std::chrono::steady_clock Clock;
+
+	std::string assetsDir = "assets";
+	unsigned    level     = 0;
+	unsigned    nTicks    = 1000000;
+	unsigned    tickRate  = 60;
+	InputScript script;
+	bool        checkHash    = false;
+	uint64      expectedHash = 0;
+	std::string recPath;
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if(i + 1 == argc) {
+			fprintf(stderr, "simulate: missing value for %s\n", arg.c_str());
+			return EXIT_FAILURE;
+		}
+		if(arg == "--assets")
+			assetsDir = argv[++i];
+		else if(arg == "--level")
+			level = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--ticks")
+			nTicks = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--tick-rate")
+			tickRate = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--input") {
+			if(!script.load(argv[++i], dbgLogger))
+				return EXIT_FAILURE;
+		}
+		else if(arg == "--expect-hash") {
+			checkHash    = true;
+			expectedHash = std::strtoull(argv[++i], nullptr, 16);
+		}
+		else if(arg == "--replay")
+			recPath = argv[++i];
+		else {
+			fprintf(stderr, "Usage: %s [--assets <dir>] [--level <n>] [--ticks <n>]"
+			                " [--tick-rate <n>] [--input <script>] [--expect-hash <hex>]\n"
+			                "       %s [--assets <dir>] --replay <file.rec>\n",
+			        argv[0], argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(!recPath.empty())
+		return replay(assetsDir, recPath);
+
+	if(tickRate < MIN_TICK_RATE || tickRate > MAX_TICK_RATE) {
+		fprintf(stderr, "simulate: tick rate must be in [%d, %d]\n",
+		        MIN_TICK_RATE, MAX_TICK_RATE);
+		return EXIT_FAILURE;
+	}
+	if(script.empty())
+		script.addLine(0, SimInput::ACCEL);
+
+	Json::Value maps;
+	if(!parseJsonFile(maps, assetsDir + "/maps.json"))
+		return EXIT_FAILURE;
+	if(level >= maps.size()) {
+		fprintf(stderr, "simulate: there are only %u levels\n", maps.size());
+		return EXIT_FAILURE;
+	}
+	const Json::Value& info = maps[level];
+
+	std::string shipPath = assetsDir + "/" + info.get("ship", "ship_default.json").asString();
+	Json::Value shipJson;
+	ShipDef shipDef;
+	if(!parseJsonFile(shipJson, shipPath) || !shipDef.load(shipJson, BLOCK_SIZE, dbgLogger))
+		return EXIT_FAILURE;
+
+	Map map(nullptr, BLOCK_SIZE);
+	Simulation sim(&map, BLOCK_SIZE);
+	sim.setTickDuration(ONE_SEC / tickRate);
+
+	unsigned runs     = 0;
+	unsigned deaths   = 0;
+	unsigned finishes = 0;
+	float    bestDistance = 0;
+	float    bestScore    = 0;
+	uint8    buttons  = 0;
+	uint64   hash     = SIM_HASH_SEED;
+
+	Clock::time_point start = Clock::now();
+	for(unsigned t = 0; t < nTicks; ++t) {
+		const SimState& state = sim.state();
+		sim.tickDeathTimer();
+		if(t == 0 || state.deathTimer > int64(ONE_SEC)
+		|| (state.isAlive() && sim.isFinished())) {
+			if(t != 0) {
+				deaths   += !state.isAlive();
+				finishes +=  state.isAlive();
+			}
+			if(!loadLevel(map, info, assetsDir, level))
+				return EXIT_FAILURE;
+			sim.start(shipDef);
+			sim.streamMap();
+			buttons = 0;
+			++runs;
+		}
+
+		SimInput input;
+		input.buttons = script.buttons(state.ticks);
+		input.pressed = input.buttons & ~buttons;
+		buttons = input.buttons;
+
+		sim.tick(input);
+		hash = hashSimState(state, hash);
+
+		bestDistance = std::max(bestDistance, state.distance);
+		bestScore    = std::max(bestScore,    state.score);
+	}
+	Clock::time_point end = Clock::now();
+
+	double secs = std::chrono::duration<double>(end - start).count();
+	printf("%u ticks at %u ticks/s in %.3f s: %.0f ticks/s, %.1fx real time\n",
+	       nTicks, tickRate, secs, nTicks / secs, nTicks / secs / tickRate);
+	printf("%u runs, %u deaths, %u finishes\n", runs, deaths, finishes);
+	printf("best distance: %.2f km, best score: %.0f\n",
+	       bestDistance / 1000, bestScore * 1000);
+	printf("state hash: %016llx\n", (unsigned long long)hash);
+
+	if(checkHash && hash != expectedHash) {
+		fprintf(stderr, "simulate: the state hash should be %016llx\n",
+		        (unsigned long long)expectedHash);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
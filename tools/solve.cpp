@@ -0,0 +1,611 @@
+/*
+ *  Copyright (C) 2016 the authors (see AUTHORS)
+ *
+ *  This file is part of ld35.
+ *
+ *  lair is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  lair is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with lair.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+// solve: search the ways through the levels of maps.json with the game
+// physics, and tell whether each can be finished with the ship alive, the
+// best score a run can reach compared to the min_score of the level, and
+// where the tightest passages are.
+//
+// Usage: solve [--assets <dir>] [--level <n>] [--tick-rate <n>] [--threads <n>]
+//              [--check-threads <n>] [--columns <n>]
+//
+// The search goes column by column. A state of the ship is reduced to a cell
+// (column, row, shape, speed band), and only the best scoring ship of each
+// cell is kept. Every ship of the current column is played with each action
+// (held buttons) for a few columns, with the real Simulation
+// and Map, so crashes and pickups follow the game rules exactly. A level the
+// search finishes can be finished; one it does not is very likely too hard,
+// but keeping one ship per cell makes the search incomplete, so it is not a
+// proof. The ships of a column are expanded on every core: each worker has a
+// queue of them, and steals from the others when its own runs out.
+//
+// The report does not depend on the number of threads: --check-threads solves
+// each level again on another number of threads and fails if the reports
+// differ.
+//
+// --columns stops the search at a column of each level, which counts as its
+// end: the report is the one of the shorter level.
+//
+// The levels must be compiled (see levelc). Generated levels are skipped.
+
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lair/core/lair.h>
+#include <lair/core/log.h>
+#include <lair/core/json.h>
+
+#include "batch_simulation.h"
+#include "parallel.h"
+
+
+// As in MainState.
+#define BLOCK_SIZE 48
+
+// Speeds are banded by half octaves from the minimum ship speed.
+#define MIN_SPEED   1000
+#define SPEED_BANDS 8
+#define MAX_ROWS    32
+
+// Columns an action is held for. The vertical speed is not part of a cell,
+// so a step must be long enough for a climb or a dive to change rows.
+#define STEP_COLUMNS 4
+
+// Passages are only looked for once the ships had two screens to spread out
+// from the start row.
+#define SPREAD_COLUMNS (2 * SCREEN_WIDTH / BLOCK_SIZE)
+
+
+using namespace lair;
+
+
+// The best ship found in a cell (column, row, shape, speed band).
+struct Node {
+	SimState         state;
+	uint8            buttons; // Held during the last tick.
+	unsigned         points;
+	// Step column, index of the parent in it and action that led here. It
+	// breaks ties between equal ships, so that the one kept does not depend
+	// on which worker found it first.
+	uint64           origin;
+	// The points picked up on the way that are still ahead of the left edge
+	// of the screen, which the shared map must not show to this ship.
+	std::vector<int> picked;
+};
+
+bool isBetter(float score, unsigned points, uint64 origin, const Node& other) {
+	if(score != other.state.score)
+		return score > other.state.score;
+	if(points != other.points)
+		return points > other.points;
+	return origin < other.origin;
+}
+
+typedef std::unordered_map<uint32, Node> CellMap;
+typedef std::map<int, CellMap>           Frontier; // By step column.
+
+
+int shipColumn(const SimState& state) {
+	return int((state.scrollPos + state.shipPos(0)) / BLOCK_SIZE);
+}
+
+// Ships are merged by steps of STEP_COLUMNS, as they do not all reach the
+// same column at the end of a step.
+int stepColumn(const SimState& state) {
+	return shipColumn(state) / STEP_COLUMNS * STEP_COLUMNS;
+}
+
+int shipRow(const SimState& state) {
+	return std::max(0, std::min(MAX_ROWS - 1,
+	                            int(std::floor(state.shipPos(1) / BLOCK_SIZE + .5f))));
+}
+
+uint32 cellKey(const SimState& state) {
+	int band = std::log2(std::max(state.shipHSpeed, float(MIN_SPEED)) / MIN_SPEED) * 2;
+	band = std::min(band, SPEED_BANDS - 1);
+	return (uint32(state.shipShape) * SPEED_BANDS + band) * MAX_ROWS + shipRow(state);
+}
+
+
+// The buttons held by the actions tried from each ship. Without accel or
+// brake, the ship keeps its speed; shape changes are tried alone.
+std::vector<uint8> actions() {
+	static const uint8 speeds[] = { SimInput::ACCEL, 0, SimInput::BRAKE };
+	static const uint8 moves[]  = { 0, SimInput::CLIMB, SimInput::DIVE };
+
+	std::vector<uint8> actions;
+	for(uint8 speed: speeds) {
+		for(uint8 move: moves)
+			actions.push_back(speed | move);
+	}
+	actions.push_back(SimInput::STRETCH);
+	actions.push_back(SimInput::SHRINK);
+	return actions;
+}
+
+
+// Work-stealing queues of indices: each worker pops from the back of its
+// own, and steals from the front of the others.
+class WorkQueues {
+public:
+	WorkQueues(unsigned count) {
+		for(unsigned i = 0; i < count; ++i)
+			_queues.emplace_back(new Queue);
+	}
+
+	// Deal [0, count) in contiguous blocks, so that workers start with
+	// neighbour ships.
+	void deal(unsigned count) {
+		unsigned nQueues = _queues.size();
+		for(unsigned q = 0; q < nQueues; ++q) {
+			std::lock_guard<std::mutex> lock(_queues[q]->mutex);
+			for(unsigned i = count * q / nQueues; i < count * (q + 1) / nQueues; ++i)
+				_queues[q]->items.push_back(i);
+		}
+	}
+
+	bool pop(unsigned worker, unsigned* item) {
+		{
+			Queue& own = *_queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if(!own.items.empty()) {
+				*item = own.items.back();
+				own.items.pop_back();
+				return true;
+			}
+		}
+		for(unsigned i = 1; i < _queues.size(); ++i) {
+			Queue& other = *_queues[(worker + i) % _queues.size()];
+			std::lock_guard<std::mutex> lock(other.mutex);
+			if(!other.items.empty()) {
+				*item = other.items.front();
+				other.items.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	struct Queue {
+		std::mutex           mutex;
+		std::deque<unsigned> items;
+	};
+	std::vector<std::unique_ptr<Queue>> _queues;
+};
+
+
+// A worker has its own map, kept in sync with the ship it expands.
+struct Worker {
+	Worker(float blockSize)
+	    : map(nullptr, blockSize),
+	      sim(&map, blockSize) {
+	}
+
+	Map                map;
+	Simulation         sim;
+	Frontier           children;
+	std::vector<int>   newPoints;
+	std::vector<uint32> pointMasks;
+	uint64             ticks;
+	uint64             expanded;
+	bool               finished;
+	float              bestScore;  // Of the ships that finished.
+	unsigned           mostPoints; // Of the ships alive.
+};
+
+
+struct LevelReport {
+	bool     finished;
+	int      lastColumn;
+	float    bestScore;
+	unsigned mostPoints;
+	uint64   ships;
+	uint64   ticks;
+	std::vector<unsigned> rowsReached; // By step column.
+};
+
+
+class Solver {
+public:
+	// Stop at endColumn if it is not 0.
+	Solver(const BatchSimulation& batch, unsigned level, unsigned threads,
+	       int endColumn)
+	    : _batch(batch),
+	      _level(level),
+	      _endColumn(endColumn),
+	      _actions(actions()),
+	      _queues(threads) {
+		for(unsigned w = 0; w < threads; ++w) {
+			_workers.emplace_back(new Worker(BLOCK_SIZE));
+			Worker& worker = *_workers.back();
+			worker.sim.setTickDuration(batch.tickDuration());
+			batch.resetMap(level, worker.map);
+			worker.ticks      = 0;
+			worker.expanded   = 0;
+			worker.finished   = false;
+			worker.bestScore  = 0;
+			worker.mostPoints = 0;
+		}
+
+		// The columns the ship and its parts may reach in a step, relative
+		// to the ship: parts are 3 blocks wide, and the last tick of a step
+		// can go 2 columns further. Parts lag behind their place in the
+		// shape.
+		const ShipDef& shipDef = batch.shipDef(level);
+		float minX = 0;
+		float maxX = 0;
+		for(unsigned shape = 0; shape < shipDef.shapeCount(); ++shape) {
+			for(unsigned part = 0; part < shipDef.partCount(); ++part) {
+				minX = std::min(minX, shipDef.shapeX(shape)[part]);
+				maxX = std::max(maxX, shipDef.shapeX(shape)[part]);
+			}
+		}
+		_windowBegin = int(std::floor(minX / BLOCK_SIZE)) - 2;
+		_windowEnd   = int(std::ceil (maxX / BLOCK_SIZE)) + 3 + STEP_COLUMNS + 4;
+	}
+
+	LevelReport solve() {
+		LevelReport report;
+		report.rowsReached.assign(_batch.levelLength(_level) + 1, 0);
+
+		Frontier frontier;
+		{
+			Worker& worker = *_workers[0];
+			worker.sim.start(_batch.shipDef(_level));
+			Node start;
+			start.state   = worker.sim.state();
+			start.buttons = 0;
+			start.points  = 0;
+			start.origin  = 0;
+			frontier[stepColumn(start.state)][cellKey(start.state)] = start;
+		}
+
+		std::vector<Node> ships;
+		report.lastColumn = 0;
+		report.ships      = 0;
+		while(!frontier.empty()) {
+			int col = frontier.begin()->first;
+			if(_endColumn && col >= _endColumn) {
+				// The remaining ships are all past the end: they finished.
+				Worker& worker = *_workers[0];
+				for(const auto& column: frontier) {
+					for(const auto& cell: column.second) {
+						float score = cell.second.state.score;
+						if(!worker.finished || score > worker.bestScore)
+							worker.bestScore = score;
+						worker.finished = true;
+					}
+				}
+				report.lastColumn = col;
+				break;
+			}
+			ships.clear();
+			uint32 rows = 0;
+			// By cell, as the order of an unordered_map depends on its
+			// history, and the origin of the children on this order.
+			std::vector<uint32> keys;
+			for(const auto& cell: frontier.begin()->second)
+				keys.push_back(cell.first);
+			std::sort(keys.begin(), keys.end());
+			for(uint32 key: keys) {
+				Node& ship = frontier.begin()->second[key];
+				rows |= 1u << shipRow(ship.state);
+				ships.push_back(std::move(ship));
+			}
+			frontier.erase(frontier.begin());
+			report.lastColumn = col;
+			report.ships     += ships.size();
+			if(col >= 0 && col < int(report.rowsReached.size())) {
+				for(; rows; rows &= rows - 1)
+					++report.rowsReached[col];
+			}
+
+			expandColumn(col, ships);
+
+			for(std::unique_ptr<Worker>& worker: _workers) {
+				for(auto& column: worker->children) {
+					CellMap& cells = frontier[column.first];
+					for(auto& cell: column.second) {
+						const Node& node = cell.second;
+						CellMap::iterator it = cells.find(cell.first);
+						if(it == cells.end())
+							cells.emplace(cell.first, std::move(cell.second));
+						else if(isBetter(node.state.score, node.points, node.origin, it->second))
+							it->second = std::move(cell.second);
+					}
+				}
+				worker->children.clear();
+			}
+		}
+
+		report.finished   = false;
+		report.bestScore  = 0;
+		report.mostPoints = 0;
+		report.ticks      = 0;
+		for(const std::unique_ptr<Worker>& worker: _workers) {
+			report.ticks += worker->ticks;
+			if(worker->finished && (!report.finished || worker->bestScore > report.bestScore))
+				report.bestScore = worker->bestScore;
+			report.mostPoints = std::max(report.mostPoints, worker->mostPoints);
+			report.finished  |= worker->finished;
+		}
+		return report;
+	}
+
+private:
+	void expandColumn(int col, const std::vector<Node>& ships) {
+		// The ships of a column do not have the same left edge, and the map
+		// of a worker is only streamed forward. Keep it materialized from
+		// the leftmost one, so that no ship evicts the columns of another,
+		// whatever the order the workers get them in.
+		const Simulation& sim = _workers[0]->sim;
+		int beginCol = std::numeric_limits<int>::max();
+		for(const Node& ship: ships)
+			beginCol = std::min(beginCol, sim.streamBeginColumn(ship.state));
+
+		_queues.deal(ships.size());
+		parallelFor(_workers.size(), [&](unsigned w) {
+			Worker& worker = *_workers[w];
+			if(worker.map.firstColumn() > beginCol)
+				_batch.resetMap(_level, worker.map);
+			worker.map.keepFrom(beginCol);
+
+			unsigned ship;
+			while(_queues.pop(w, &ship))
+				expand(worker, col, ship, ships[ship]);
+		});
+	}
+
+	void expand(Worker& w, int col, unsigned index, const Node& node) {
+		Map&        map = w.map;
+		Simulation& sim = w.sim;
+		const SimState& s = sim.state();
+
+		sim.setState(node.state);
+		sim.streamMap();
+		for(int bi: node.picked)
+			map.clearBlock(bi);
+
+		int beginCol = std::max(0, col + _windowBegin);
+		int endCol   = col + _windowEnd;
+		w.pointMasks.resize(endCol - beginCol);
+		for(int c = beginCol; c < endCol; ++c)
+			w.pointMasks[c - beginCol] = map.pointMask(c);
+
+		for(unsigned action = 0; action < _actions.size(); ++action) {
+			uint8 buttons = _actions[action];
+			uint64 origin = (uint64(uint32(col)) << 32) | (index * _actions.size() + action);
+			sim.setState(node.state);
+			SimInput input;
+			input.buttons = buttons;
+			input.pressed = buttons & ~node.buttons;
+			while(s.isAlive() && !sim.isFinished() && shipColumn(s) < col + STEP_COLUMNS) {
+				sim.tick(input);
+				input.pressed = 0;
+				++w.ticks;
+			}
+			++w.expanded;
+
+			w.newPoints.clear();
+			for(int c = beginCol; c < endCol; ++c) {
+				uint32 picked = w.pointMasks[c - beginCol] & ~map.pointMask(c);
+				for(; picked; picked &= picked - 1) {
+					unsigned row = 0;
+					while(!(picked & (1u << row))) ++row;
+					w.newPoints.push_back(map.beginIndex(c) + row);
+				}
+			}
+			unsigned points = node.points + w.newPoints.size();
+			if(s.isAlive())
+				w.mostPoints = std::max(w.mostPoints, points);
+
+			if(s.isAlive() && sim.isFinished()) {
+				if(!w.finished || s.score > w.bestScore)
+					w.bestScore = s.score;
+				w.finished = true;
+			}
+			else if(s.isAlive()) {
+				// Only the best ship of a cell is copied, in place of the
+				// previous one when there is one.
+				CellMap& cells = w.children[stepColumn(s)];
+				uint32 cell = cellKey(s);
+				CellMap::iterator it = cells.find(cell);
+				if(it == cells.end() || isBetter(s.score, points, origin, it->second)) {
+					Node& child = cells[cell];
+					child.state   = s;
+					child.buttons = buttons;
+					child.points  = points;
+					child.origin  = origin;
+					child.picked.clear();
+					int leftCol = sim.streamBeginColumn(s);
+					for(int bi: node.picked) {
+						if(map.blockColumn(bi) >= leftCol)
+							child.picked.push_back(bi);
+					}
+					for(int bi: w.newPoints) {
+						if(map.blockColumn(bi) >= leftCol)
+							child.picked.push_back(bi);
+					}
+				}
+			}
+
+			for(int bi: w.newPoints)
+				map.restorePoint(bi);
+		}
+
+		for(int bi: node.picked)
+			map.restorePoint(bi);
+	}
+
+private:
+	const BatchSimulation& _batch;
+	unsigned               _level;
+	int                    _endColumn;
+	std::vector<uint8>     _actions;
+	WorkQueues             _queues;
+	std::vector<std::unique_ptr<Worker>> _workers;
+	int                    _windowBegin;
+	int                    _windowEnd;
+};
+
+
+bool sameReport(const LevelReport& a, const LevelReport& b) {
+	return a.finished    == b.finished
+	    && a.lastColumn  == b.lastColumn
+	    && a.bestScore   == b.bestScore
+	    && a.mostPoints  == b.mostPoints
+	    && a.ships       == b.ships
+	    && a.ticks       == b.ticks
+	    && a.rowsReached == b.rowsReached;
+}
+
+
+// The columns where the fewest rows are reachable, at least 8 columns apart.
+std::vector<int> tightestPassages(const std::vector<unsigned>& rowsReached, unsigned count) {
+	std::vector<std::pair<unsigned, int>> columns;
+	for(int col = SPREAD_COLUMNS; col < int(rowsReached.size()); ++col) {
+		if(rowsReached[col])
+			columns.push_back(std::make_pair(rowsReached[col], col));
+	}
+	std::sort(columns.begin(), columns.end());
+
+	std::vector<int> passages;
+	for(unsigned i = 0; i < columns.size() && passages.size() < count; ++i) {
+		bool near = false;
+		for(int col: passages)
+			near |= std::abs(col - columns[i].second) < 8;
+		if(!near)
+			passages.push_back(columns[i].second);
+	}
+	return passages;
+}
+
+
+int main(int argc, char** argv) {
+	typedef std::chrono::steady_clock Clock;
+
+	std::string assetsDir    = "assets";
+	int         onlyLevel    = -1;
+	unsigned    tickRate     = 60;
+	unsigned    threads      = workerCount();
+	unsigned    checkThreads = 0;
+	int         endColumn    = 0;
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if(i + 1 == argc) {
+			fprintf(stderr, "solve: missing value for %s\n", arg.c_str());
+			return EXIT_FAILURE;
+		}
+		if(arg == "--assets")
+			assetsDir = argv[++i];
+		else if(arg == "--level")
+			onlyLevel = std::strtol(argv[++i], nullptr, 10);
+		else if(arg == "--tick-rate")
+			tickRate = std::strtoul(argv[++i], nullptr, 10);
+		else if(arg == "--threads")
+			threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+		else if(arg == "--check-threads")
+			checkThreads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+		else if(arg == "--columns")
+			endColumn = std::max(1l, std::strtol(argv[++i], nullptr, 10));
+		else {
+			fprintf(stderr, "Usage: %s [--assets <dir>] [--level <n>] [--tick-rate <n>]"
+			        " [--threads <n>] [--check-threads <n>] [--columns <n>]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(tickRate < MIN_TICK_RATE || tickRate > MAX_TICK_RATE) {
+		fprintf(stderr, "solve: tick rate must be in [%d, %d]\n",
+		        MIN_TICK_RATE, MAX_TICK_RATE);
+		return EXIT_FAILURE;
+	}
+
+	Json::Value maps;
+	if(!parseJson(maps, Path(assetsDir) / "maps.json", "maps.json", dbgLogger))
+		return EXIT_FAILURE;
+
+	BatchSimulation batch(BLOCK_SIZE);
+	batch.setTickDuration(ONE_SEC / tickRate);
+	if(!batch.loadLevels(Path(assetsDir), maps, dbgLogger))
+		return EXIT_FAILURE;
+
+	bool allFinished = true;
+	bool allSame     = true;
+	for(unsigned level = 0; level < batch.levelCount(); ++level) {
+		if(!batch.hasLevel(level) || (onlyLevel >= 0 && int(level) != onlyLevel))
+			continue;
+
+		int levelEnd = endColumn < batch.levelLength(level)? endColumn: 0;
+
+		Clock::time_point start = Clock::now();
+		LevelReport report = Solver(batch, level, threads, levelEnd).solve();
+		double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+		float minScore = maps[level].get("min_score", 0).asFloat();
+		if(levelEnd)
+			printf("level %u (first %d of %d columns): ", level, levelEnd,
+			       batch.levelLength(level));
+		else
+			printf("level %u (%d columns): ", level, batch.levelLength(level));
+		if(report.finished)
+			printf("can be finished\n");
+		else
+			printf("NOT finished, the furthest ship reached column %d\n", report.lastColumn);
+		if(levelEnd)
+			printf("  best score %.0f\n", report.bestScore * 1000);
+		else
+			printf("  best score %.0f, min score %.0f%s\n", report.bestScore * 1000,
+			       minScore * 1000, report.finished && report.bestScore < minScore?
+			           ": TOO HIGH": "");
+		printf("  most points picked up %u of %u\n", report.mostPoints,
+		       batch.levelPointCount(level));
+		printf("  tightest passages (column: reachable rows):");
+		for(int col: tightestPassages(report.rowsReached, 5))
+			printf(" %d: %u", col, report.rowsReached[col]);
+		printf("\n  %llu ships, %llu ticks in %.3f s on %u threads\n",
+		       (unsigned long long)report.ships, (unsigned long long)report.ticks,
+		       secs, threads);
+		allFinished &= report.finished;
+
+		if(checkThreads) {
+			bool same = sameReport(report,
+			                       Solver(batch, level, checkThreads, levelEnd).solve());
+			printf("  on %u threads: %s\n", checkThreads, same? "same report": "DIFFERENT REPORT");
+			allSame &= same;
+		}
+	}
+
+	return allFinished && allSame? EXIT_SUCCESS: EXIT_FAILURE;
+}